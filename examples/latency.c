@@ -0,0 +1,119 @@
+/**
+ * \file   latency.c
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Measuring the latency of single-sample inference.
+ *
+ * A control loop evaluates the policy on one state at a time, so the time of
+ * each individual call matters more than the throughput. This program builds
+ * an actor network with the same architecture as the one in the pendulum
+ * example and measures the latency of three ways to evaluate it on a single
+ * state:
+ *
+ *   - batch:  the whole batch is cleared and evaluated, and only the first
+ *             row is used (the way `ddpg_action` used to work),
+ *   - gemm:   a batch of one row is given to `mlp_feedforward`,
+ *   - single: the state is given to `mlp_feedforward_single`.
+ *
+ * For each method the 50th, 99th and 99.9th percentile of the call latency is
+ * reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mlpc.h"
+
+#define STATE_SIZE 2
+#define ACTION_SIZE 1
+#define BATCH_SIZE 32
+
+#define WARMUP 1000
+#define ITERATIONS 100000
+
+/* Returns the current time in nanoseconds. */
+double now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Evaluates the actor with the given method and returns the first action. */
+double evaluate(MLP *actor, Matrix batch, int method)
+{
+    Matrix output;
+    switch (method)
+    {
+        case 0:
+            matrix_clear(batch);
+            batch.data[0] = 0.5;
+            batch.data[1] = -0.25;
+            output = mlp_feedforward(actor, batch);
+            break;
+        case 1:
+            batch = matrix_rows(batch, 0, 1);
+            batch.data[0] = 0.5;
+            batch.data[1] = -0.25;
+            output = mlp_feedforward(actor, batch);
+            break;
+        default:
+            batch = matrix_rows(batch, 0, 1);
+            batch.data[0] = 0.5;
+            batch.data[1] = -0.25;
+            output = mlp_feedforward_single(actor, batch);
+    }
+    return output.data[0];
+}
+
+int main()
+{
+    const char *names[3] = { "batch", "gemm", "single" };
+    double *times = malloc(ITERATIONS * sizeof(double));
+    double checksum = 0;
+
+    mlp_init();
+
+    /* The same architecture as the actor in the pendulum example. */
+    int layers[2] = {128, 64};
+    MLP *actor = mlp_create(STATE_SIZE, ACTION_SIZE, 2, layers, ACTIVATION_RELU, ACTIVATION_TANH, BATCH_SIZE);
+    Matrix batch = matrix_create(BATCH_SIZE, STATE_SIZE);
+
+    printf("Latency of a single actor evaluation in microseconds:\n");
+    printf("%-8s %10s %10s %10s\n", "method", "p50", "p99", "p999");
+
+    for (int method = 0; method < 3; method++)
+    {
+        for (int i = 0; i < WARMUP; i++)
+            checksum += evaluate(actor, batch, method);
+
+        for (int i = 0; i < ITERATIONS; i++)
+        {
+            double start = now();
+            checksum += evaluate(actor, batch, method);
+            times[i] = now() - start;
+        }
+
+        qsort(times, ITERATIONS, sizeof(double), compare);
+        printf("%-8s %10.3f %10.3f %10.3f\n", names[method],
+            times[ITERATIONS / 2] / 1000,
+            times[ITERATIONS * 99 / 100] / 1000,
+            times[ITERATIONS * 999 / 1000] / 1000);
+    }
+
+    /* Printing the checksum keeps the compiler from removing the evaluations. */
+    printf("(checksum %g)\n", checksum);
+
+    matrix_destroy(batch);
+    mlp_destroy(actor);
+    free(times);
+
+    return 0;
+}
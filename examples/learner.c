@@ -0,0 +1,171 @@
+/**
+ * \file   learner.c
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Solving the pendulum swing up problem with an asynchronous learner.
+ *
+ * This is the pendulum example (see pendulum.c), in which the environments
+ * and the training run on separate threads. A learner trains the DDPG on its
+ * own thread, while several acting threads each swing up their own pendulum,
+ * act with the latest published weights of the actor and pass the observed
+ * transitions to the learner.
+ *
+ * The simulation of the pendulum is very fast, so each step is made
+ * artificially slow to resemble an expensive simulator. The learner makes up
+ * to `UPDATE_TO_DATA` training steps per observed transition, and the
+ * episode rewards and the metrics of the learner are printed as the training
+ * goes on.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <threads.h>
+#include "ddpgc.h"
+
+#define PI 3.14159265358979323846
+
+#define MAX_SPEED 8.0
+#define DT 0.05
+#define G 9.81
+#define MASS 1.0
+#define LENGTH 1.0
+
+#define EPISODE_LENGTH 200
+#define EPISODE_COUNT 50
+#define STARTING_EPISODES 2
+
+/* The number of acting threads, each with its own pendulum. */
+#define ACTORS 2
+
+/* The time in microseconds that each simulation step takes. */
+#define STEP_TIME 500
+
+/* The largest number of training steps per observed transition. */
+#define UPDATE_TO_DATA 2
+
+/* The number of transitions that the queue of the learner can hold. */
+#define QUEUE_CAPACITY 1024
+
+/* Simulate the motion of the pendulum and return the reward of the current state. */
+double pendulum_step(double *state, double action)
+{
+    double theta = state[0];
+    double thetadot = state[1];
+
+    double cost = pow(theta, 2) + 0.1 * pow(thetadot, 2) + 0.001 * pow(action, 2);
+
+    thetadot += (3 * G / (2 * LENGTH) * sin(theta) + 3.0 / (MASS * pow(LENGTH, 2)) * action) * DT;
+    if (thetadot < -MAX_SPEED)
+        thetadot = -MAX_SPEED;
+    if (thetadot > MAX_SPEED)
+        thetadot = MAX_SPEED;
+
+    theta = theta + thetadot * DT;
+    if (theta > PI)
+        theta -= 2 * PI;
+    if (theta < -PI)
+        theta += 2 * PI;
+
+    state[0] = theta;
+    state[1] = thetadot;
+
+    /* Pretend that the simulation is expensive. */
+    struct timespec duration = { 0, STEP_TIME * 1000 };
+    thrd_sleep(&duration, NULL);
+
+    return -cost;
+}
+
+/* The work of one acting thread. */
+typedef struct Acting
+{
+    int index;
+    Learner *learner;
+} Acting;
+
+int acting_run(void *arg)
+{
+    Acting *acting = arg;
+
+    /* Each acting thread has its own actor of the learner. */
+    LearnerActor *actor = learner_actor_create(acting->learner);
+
+    double state[2];
+    double action[1];
+
+    for (int episode = 0; episode < EPISODE_COUNT; episode++)
+    {
+        double episodeReward = 0;
+
+        state[0] = deepc_random_double(-PI, PI);
+        state[1] = 0;
+        learner_actor_new_episode(actor);
+
+        for (int step = 0; step < EPISODE_LENGTH; step++)
+        {
+            /* For the first few episodes only do random exploration. */
+            if (episode < STARTING_EPISODES)
+                action[0] = deepc_random_double(-1, 1);
+            else
+                action[0] = *learner_actor_action(actor, state);
+
+            double reward = pendulum_step(state, 2 * action[0]);
+            episodeReward += reward;
+
+            /* The transition is queued for the learner, which trains in the meantime. */
+            learner_actor_observe(actor, action, reward, state, 0);
+        }
+
+        /* The first thread reports its episodes together with the metrics of the learner. */
+        if (acting->index == 0)
+        {
+            LearnerStats stats;
+            learner_get_stats(acting->learner, &stats);
+            printf("%d %f (steps %lld, update-to-data %.2f, queue %d/%d, dropped %lld)\n", episode,
+                episodeReward / EPISODE_LENGTH, stats.steps, stats.updateToData, stats.queueDepth,
+                stats.maxQueueDepth, stats.dropped);
+        }
+    }
+
+    learner_actor_destroy(actor);
+    return 0;
+}
+
+int main()
+{
+    ddpg_init();
+
+    /* The same DDPG as in the pendulum example. */
+    int layers[2] = {128, 64};
+    double noise[1] = {0.01};
+    DDPG *ddpg = ddpg_create(2, 1, noise, 2, layers, 2, layers, 100000, 32);
+
+    /* From now on, the DDPG is trained by the learner. */
+    Learner *learner = learner_create(ddpg, 0.99, 0.005, UPDATE_TO_DATA, QUEUE_CAPACITY);
+    if (learner == NULL)
+    {
+        printf("Could not start the learner.\n");
+        ddpg_destroy(ddpg);
+        return 1;
+    }
+
+    thrd_t threads[ACTORS];
+    Acting acting[ACTORS];
+    for (int i = 0; i < ACTORS; i++)
+    {
+        acting[i] = (Acting){ i, learner };
+        thrd_create(&threads[i], acting_run, &acting[i]);
+    }
+
+    for (int i = 0; i < ACTORS; i++)
+        thrd_join(threads[i], NULL);
+
+    LearnerStats stats;
+    learner_get_stats(learner, &stats);
+    printf("Transitions: %lld, dropped: %lld, training steps: %lld\n", stats.transitions, stats.dropped, stats.steps);
+
+    learner_destroy(learner);
+    ddpg_destroy(ddpg);
+
+    return 0;
+}
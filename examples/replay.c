@@ -0,0 +1,211 @@
+/**
+ * \file   replay.c
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Measuring the throughput of the minibatch gather.
+ *
+ * Every training step of the DDPG gathers a random minibatch from the replay
+ * memory. Once the memory is much larger than the caches, each transition of
+ * the minibatch is a cache miss, and the gather is limited by the memory
+ * latency. This program compares two ways of gathering a minibatch from
+ * memories of increasing size:
+ *
+ *   - rows:   the transitions are stored as rows of one matrix, and each
+ *             network input is filled in its own pass over the batch (the
+ *             way `ddpg_train` used to work),
+ *   - replay: the transitions are stored in a `Replay` as records aligned to
+ *             cache lines, and all the inputs are filled in one pass with
+ *             `replay_gather`, which prefetches a block of transitions ahead.
+ *
+ * The state and action dimensions are those of a typical locomotion task. For
+ * each memory size, the number of gathered transitions per microsecond is
+ * reported.
+ *
+ * The program then measures the prioritized sampling on memories of up to 10
+ * million transitions. Each step samples a batch together with the
+ * importance-sampling weights and updates the priorities of the batch, and
+ * the number of transitions sampled and updated per microsecond is reported.
+ *
+ * The replay memory is an internal unit of the DDPGC library, so its header is
+ * included from the source tree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/ddpgc/replay.h"
+
+#define STATE_SIZE 17
+#define ACTION_SIZE 6
+#define BATCH_SIZE 256
+
+/* The number of transitions gathered for each memory size and method. */
+#define TRANSITIONS 20000000
+
+/* The number of transitions sampled for each memory size with prioritization. */
+#define PRIORITIZED 5000000
+
+/* Returns the current time in nanoseconds. */
+double now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void copy(Scalar *dst, const Scalar *src, int length)
+{
+    for (int i = 0; i < length; i++)
+        dst[i] = src[i];
+}
+
+/* Gathers the batch from a matrix of rows (state, action, reward, next state, terminal). */
+void gather_rows(Matrix memory, int *indices, Matrix actorInput, Matrix criticInput, Matrix actions,
+    Matrix targetInput, Matrix criticTargetInput, Matrix rewards, Matrix terminals)
+{
+    int next = STATE_SIZE + ACTION_SIZE + 1;
+
+    for (int i = 0; i < BATCH_SIZE; i++)
+        copy(&MATRIX(actorInput, i, 0), &MATRIX(memory, indices[i], 0), STATE_SIZE);
+
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        copy(&MATRIX(criticInput, i, ACTION_SIZE), &MATRIX(memory, indices[i], 0), STATE_SIZE);
+        copy(&MATRIX(actions, i, 0), &MATRIX(memory, indices[i], STATE_SIZE), ACTION_SIZE);
+    }
+
+    for (int i = 0; i < BATCH_SIZE; i++)
+        copy(&MATRIX(targetInput, i, 0), &MATRIX(memory, indices[i], next), STATE_SIZE);
+
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        copy(&MATRIX(criticTargetInput, i, ACTION_SIZE), &MATRIX(memory, indices[i], next), STATE_SIZE);
+        MATRIX(rewards, i, 0) = MATRIX(memory, indices[i], (STATE_SIZE + ACTION_SIZE));
+        MATRIX(terminals, i, 0) = MATRIX(memory, indices[i], (2 * STATE_SIZE + ACTION_SIZE + 1));
+    }
+}
+
+int main()
+{
+    const int sizes[5] = { 10000, 100000, 300000, 1000000, 2000000 };
+    const int rowSize = 2 * STATE_SIZE + ACTION_SIZE + 2;
+    const int batches = TRANSITIONS / BATCH_SIZE;
+    double checksum = 0;
+
+    mlp_init();
+
+    DeepcRng rng;
+    deepc_rng_seed(&rng, 1);
+
+    int *indices = malloc(BATCH_SIZE * sizeof(int));
+    Scalar *transition = malloc(rowSize * sizeof(Scalar));
+    Matrix actorInput = matrix_create(BATCH_SIZE, STATE_SIZE);
+    Matrix criticInput = matrix_create(BATCH_SIZE, ACTION_SIZE + STATE_SIZE);
+    Matrix actions = matrix_create(BATCH_SIZE, ACTION_SIZE);
+    Matrix targetInput = matrix_create(BATCH_SIZE, STATE_SIZE);
+    Matrix criticTargetInput = matrix_create(BATCH_SIZE, ACTION_SIZE + STATE_SIZE);
+    Matrix rewards = matrix_create(BATCH_SIZE, 1);
+    Matrix terminals = matrix_create(BATCH_SIZE, 1);
+
+    ReplayBatch batch = {
+        .states = { { actorInput.data, STATE_SIZE }, { criticInput.data + ACTION_SIZE, ACTION_SIZE + STATE_SIZE } },
+        .actions = { actions.data, ACTION_SIZE },
+        .rewards = { rewards.data, 1 },
+        .nextStates = { { targetInput.data, STATE_SIZE }, { criticTargetInput.data + ACTION_SIZE, ACTION_SIZE + STATE_SIZE } },
+        .terminals = { terminals.data, 1 } };
+
+    printf("Gathered transitions per microsecond (batch of %d):\n", BATCH_SIZE);
+    printf("%10s %10s %10s %10s\n", "memory", "MB", "rows", "replay");
+
+    for (int s = 0; s < 5; s++)
+    {
+        int size = sizes[s];
+
+        /* Both memories hold the same random transitions. */
+        Matrix memory = matrix_create(size, rowSize);
+        Replay *replay = replay_create(size, STATE_SIZE, ACTION_SIZE);
+        for (int i = 0; i < size; i++)
+        {
+            deepc_rng_fill_uniform(&rng, transition, rowSize, -1, 1);
+            copy(&MATRIX(memory, i, 0), transition, rowSize);
+            replay_add(replay, transition, transition + STATE_SIZE, transition[STATE_SIZE + ACTION_SIZE],
+                transition + STATE_SIZE + ACTION_SIZE + 1, transition[rowSize - 1] > 0);
+        }
+
+        double rowsTime = 0, replayTime = 0;
+        for (int b = 0; b < batches; b++)
+        {
+            replay_sample(replay, &rng, indices, NULL, BATCH_SIZE);
+
+            /* The methods alternate, so both see the same state of the caches. */
+            double start = now();
+            gather_rows(memory, indices, actorInput, criticInput, actions, targetInput, criticTargetInput, rewards, terminals);
+            rowsTime += now() - start;
+            checksum += MATRIX(criticTargetInput, 0, ACTION_SIZE);
+
+            replay_sample(replay, &rng, indices, NULL, BATCH_SIZE);
+
+            start = now();
+            replay_gather(replay, indices, BATCH_SIZE, &batch);
+            replayTime += now() - start;
+            checksum += MATRIX(criticTargetInput, 0, ACTION_SIZE);
+        }
+
+        printf("%10d %10.1f %10.1f %10.1f\n", size, (double)size * rowSize * sizeof(Scalar) / (1 << 20),
+            1e3 * TRANSITIONS / rowsTime, 1e3 * TRANSITIONS / replayTime);
+
+        replay_destroy(replay);
+        matrix_destroy(memory);
+    }
+
+    /* The sampling does not depend on the contents of the transitions, so they are kept small. */
+    const int prioritizedSizes[4] = { 10000, 100000, 1000000, 10000000 };
+    Scalar *weights = malloc(BATCH_SIZE * sizeof(Scalar));
+    Scalar *errors = malloc(BATCH_SIZE * sizeof(Scalar));
+
+    printf("\nPrioritized transitions per microsecond (batch of %d):\n", BATCH_SIZE);
+    printf("%10s %10s\n", "memory", "replay");
+
+    for (int s = 0; s < 4; s++)
+    {
+        int size = prioritizedSizes[s];
+
+        Replay *replay = replay_create(size, 1, 1);
+        replay_prioritize(replay, 0.6, 0.4);
+        for (int i = 0; i < size; i++)
+            replay_add(replay, transition, transition, 0, transition, 0);
+
+        double time = 0;
+        for (int b = 0; b < PRIORITIZED / BATCH_SIZE; b++)
+        {
+            deepc_rng_fill_uniform(&rng, errors, BATCH_SIZE, -2, 2);
+
+            double start = now();
+            replay_sample(replay, &rng, indices, weights, BATCH_SIZE);
+            replay_update_priorities(replay, indices, errors, BATCH_SIZE);
+            time += now() - start;
+            checksum += weights[0];
+        }
+
+        printf("%10d %10.1f\n", size, 1e3 * PRIORITIZED / time);
+
+        replay_destroy(replay);
+    }
+
+    /* Printing the checksum keeps the compiler from removing the gathers. */
+    printf("(checksum %g)\n", checksum);
+
+    matrix_destroy(actorInput);
+    matrix_destroy(criticInput);
+    matrix_destroy(actions);
+    matrix_destroy(targetInput);
+    matrix_destroy(criticTargetInput);
+    matrix_destroy(rewards);
+    matrix_destroy(terminals);
+    free(errors);
+    free(weights);
+    free(transition);
+    free(indices);
+
+    return 0;
+}
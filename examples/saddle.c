@@ -71,8 +71,8 @@ int main()
         /* Feed forward the generated x values. Here we ignore the returned predictions. */
         mlp_feedforward(mlp, x);
         
-        /* Back-propagate using the MSE loss function on the true values y. */
-        loss += mlp_backpropagate(mlp, y, LOSS_MSE);
+        /* Back-propagate using the MSE loss function on the true values y. The input errors are not needed. */
+        loss += mlp_backpropagate_flags(mlp, y, LOSS_MSE, BACKPROP_PARAMETERS, 0, 0);
         
         /* Optimize the neural network with Adam. */
         adam_optimize(mlp, adam);
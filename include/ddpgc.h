@@ -13,8 +13,15 @@
  * This header is intended to be used with the precompiled lib/ddpgc static
  * library. Documentation for the exposed functions can be found within the
  * DDPGC source code.
+ *
+ * The single-precision lib/ddpgcf static library, which must be linked with
+ * lib/mlpcf, exposes the same API. It stores the experience memory and the
+ * neural networks as float, while states and actions are still passed as
+ * arrays of type double.
  */
 
+#include <stdint.h>
+
 typedef struct DDPG DDPG;
 
 void ddpg_init();
@@ -30,14 +37,56 @@ DDPG *ddpg_create(
     int memorySize,
     int batchSize);
 
+DDPG *ddpg_create_mapped(
+    const char *filename,
+    int stateSize,
+    int actionSize,
+    double *noise,
+    int actorDepth,
+    int *actorLayers,
+    int criticDepth,
+    int *criticLayers,
+    int memorySize,
+    int batchSize);
+
 void ddpg_destroy(DDPG *ddpg);
 void ddpg_observe(DDPG *ddpg, double *action, double reward, double *state, int terminal);
 double *ddpg_action(DDPG *ddpg, double *state);
+double *ddpg_action_batch(DDPG *ddpg, double *states, int n);
+void ddpg_observe_batch(DDPG *ddpg, double *actions, double *rewards, double *states, int *terminals, int n);
 void ddpg_train(DDPG *ddpg, double gamma);
+void ddpg_train_steps(DDPG *ddpg, double gamma, int k);
 void ddpg_update_target_networks(DDPG *ddpg);
+void ddpg_soft_update_target_networks(DDPG *ddpg, double tau);
+void ddpg_prioritize(DDPG *ddpg, double alpha, double beta);
+void ddpg_seed(DDPG *ddpg, uint64_t seed);
 void ddpg_new_episode(DDPG *ddpg);
+void ddpg_new_episode_env(DDPG *ddpg, int env);
 int ddpg_save_policy(DDPG *ddpg, const char *filename);
 int ddpg_load_policy(DDPG *ddpg, const char *filename);
 
+typedef struct Learner Learner;
+typedef struct LearnerActor LearnerActor;
+
+typedef struct LearnerStats
+{
+    long long transitions;
+    long long dropped;
+    long long steps;
+    double updateToData;
+    int queueDepth;
+    int maxQueueDepth;
+} LearnerStats;
+
+Learner *learner_create(DDPG *ddpg, double gamma, double tau, double ratio, int capacity);
+void learner_destroy(Learner *learner);
+void learner_get_stats(Learner *learner, LearnerStats *stats);
+LearnerActor *learner_actor_create(Learner *learner);
+void learner_actor_destroy(LearnerActor *actor);
+double *learner_actor_action(LearnerActor *actor, double *state);
+int learner_actor_observe(LearnerActor *actor, double *action, double reward, double *state, int terminal);
+void learner_actor_new_episode(LearnerActor *actor);
+
+void deepc_random_seed(uint64_t seed);
 int deepc_random_int(int min, int max);
 double deepc_random_double(double min, double max);
\ No newline at end of file
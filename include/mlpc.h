@@ -11,9 +11,19 @@
  * This header is intended to be used with the precompiled lib/mlpc static
  * library. Documentation for the exposed functions can be found within the
  * MLPC source code.
+ *
+ * To use the single-precision lib/mlpcf static library instead, define the
+ * `MLPC_FLOAT` macro before including this header.
  */
 
 #include <stdio.h>
+#include <stdint.h>
+
+#ifdef MLPC_FLOAT
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
 
 #define ACTIVATION_NONE    0
 #define ACTIVATION_LINEAR  0
@@ -24,17 +34,27 @@
 #define LOSS_NONE   0
 #define LOSS_MSE    1
 
+#define BACKPROP_PARAMETERS 1
+#define BACKPROP_INPUT      2
+#define BACKPROP_ALL        3
+
+#define SIMD_AUTO   -1
+#define SIMD_SCALAR  0
+#define SIMD_AVX2    1
+#define SIMD_AVX512  2
+
 #define MATRIX(matrix, row, col) \
     matrix.data[row * matrix.columns + col]
 
 typedef struct Matrix {
     int rows;
     int columns;
-    double *data;
+    Scalar *data;
 } Matrix;
 
 Matrix matrix_create(int rows, int columns);
 Matrix matrix_clone(Matrix matrix);
+Matrix matrix_rows(Matrix matrix, int row, int rows);
 Matrix matrix_load(const char *filename);
 int matrix_save(Matrix matrix, const char *filename);
 void matrix_destroy(Matrix matrix);
@@ -44,8 +64,15 @@ void matrix_fill(Matrix matrix, double value);
 void matrix_randomize(Matrix matrix, double min, double max);
 
 typedef struct MLP MLP;
+typedef struct MLPContext MLPContext;
+typedef void (*MLPTask)(void *arg, int index, int count);
 
 void mlp_init();
+int mlp_set_simd_level(int level);
+int mlp_get_simd_level();
+int mlp_init_threads(int threads);
+int mlp_is_parallel(MLP *mlp, int batchSize);
+void mlp_run_parallel(MLPTask task, void *arg, int count);
 
 MLP *mlp_create(
     int inputSize,
@@ -56,12 +83,30 @@ MLP *mlp_create(
     int outputLayerActivation,
     int batchSize);
 
+MLP *mlp_create_inference(
+    int inputSize,
+    int outputSize,
+    int depth,
+    int *hiddenLayerSizes,
+    int hiddenLayerActivation,
+    int outputLayerActivation,
+    int batchSize);
+
 MLP *mlp_clone(MLP *mlp);
+MLP *mlp_clone_inference(MLP *mlp);
 void mlp_destroy(MLP *mlp);
 void mlp_initialize(MLP *mlp);
 void mlp_copy(MLP *src, MLP *dst);
+void mlp_copy_params(MLP *dst, MLP *src);
+void mlp_soft_update(MLP *dst, MLP *src, double tau);
 Matrix mlp_feedforward(MLP *mlp, Matrix x);
+Matrix mlp_feedforward_single(MLP *mlp, Matrix x);
+MLPContext *mlp_context_create(MLP *mlp, int batchSize);
+void mlp_context_destroy(MLPContext *context);
+Matrix mlp_context_feedforward(MLP *mlp, MLPContext *context, Matrix x);
+Matrix mlp_context_feedforward_single(MLP *mlp, MLPContext *context, Matrix x);
 double mlp_backpropagate(MLP *mlp, Matrix y, int lossFunctionId);
+double mlp_backpropagate_flags(MLP *mlp, Matrix y, int lossFunctionId, int flags, int column, int columns);
 Matrix mlp_get_input_errors(MLP *mlp);
 void mlp_sgd(MLP *mlp, double lr);
 void mlp_sgd_clip(MLP *mlp, double lr, double clipnorm);
@@ -69,6 +114,8 @@ int mlp_load_weights(MLP *mlp, const char *filename);
 int mlp_read_weights(MLP *mlp, FILE *file);
 int mlp_save_weights(MLP *mlp, const char *filename);
 int mlp_write_weights(MLP *mlp, FILE *file);
+MLP *mlp_load_inference(const char *filename, int batchSize);
+MLP *mlp_read_inference(FILE *file, int batchSize);
 
 typedef struct Adam Adam;
 
@@ -78,5 +125,51 @@ void adam_set(Adam *adam, double alpha, double beta1, double beta2, double epsil
 void adam_reset(Adam *adam);
 void adam_optimize(MLP *mlp, Adam *adam);
 
+typedef struct QMLP QMLP;
+
+QMLP *qmlp_create(MLP *mlp, Matrix samples);
+void qmlp_destroy(QMLP *qmlp);
+Matrix qmlp_feedforward(QMLP *qmlp, Matrix x);
+double qmlp_report(QMLP *qmlp, MLP *mlp, Matrix x, FILE *stream);
+int qmlp_save(QMLP *qmlp, const char *filename);
+int qmlp_write(QMLP *qmlp, FILE *file);
+QMLP *qmlp_load(const char *filename);
+QMLP *qmlp_read(FILE *file);
+
+typedef struct Batcher Batcher;
+typedef void (*BatcherCallback)(void *arg, const Scalar *output);
+
+typedef struct BatcherStats
+{
+    long long requests;
+    long long batches;
+    double batchFill;
+    int queueDepth;
+    int maxQueueDepth;
+} BatcherStats;
+
+Batcher *batcher_create(MLP *mlp, int batchSize, int maxDelay, int capacity);
+void batcher_destroy(Batcher *batcher);
+void batcher_submit(Batcher *batcher, const Scalar *input, BatcherCallback callback, void *arg);
+void batcher_evaluate(Batcher *batcher, const Scalar *input, Scalar *output);
+void batcher_get_stats(Batcher *batcher, BatcherStats *stats);
+
+typedef struct DeepcRng
+{
+    uint64_t s[4];
+} DeepcRng;
+
+void deepc_rng_seed(DeepcRng *rng, uint64_t seed);
+uint64_t deepc_rng_next(DeepcRng *rng);
+void deepc_rng_jump(DeepcRng *rng);
+DeepcRng deepc_rng_split(DeepcRng *rng);
+int deepc_rng_int(DeepcRng *rng, int min, int max);
+double deepc_rng_double(DeepcRng *rng, double min, double max);
+double deepc_rng_gaussian(DeepcRng *rng, double mean, double stddev);
+void deepc_rng_fill_uniform(DeepcRng *rng, Scalar *dst, int n, double min, double max);
+void deepc_rng_fill_gaussian(DeepcRng *rng, Scalar *dst, int n, double mean, double stddev);
+
+void deepc_random_seed(uint64_t seed);
+DeepcRng *deepc_random_generator();
 int deepc_random_int(int min, int max);
 double deepc_random_double(double min, double max);
\ No newline at end of file
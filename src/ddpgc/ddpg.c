@@ -9,7 +9,9 @@ void ddpg_init()
     mlp_init();
 }
 
-DDPG *ddpg_create(
+/* Creates a DDPG that stores its observations in the given replay memory. */
+static DDPG *ddpg_create_with_replay(
+    Replay *replay,
     int stateSize,
     int actionSize,
     double *noise,
@@ -17,13 +19,15 @@ DDPG *ddpg_create(
     int *actorLayers,
     int criticDepth,
     int *criticLayers,
-    int memorySize,
     int batchSize)
 {
     DDPG *ddpg = malloc(sizeof(DDPG));
     ddpg->stateSize = stateSize;
     ddpg->actionSize = actionSize;
 
+    /* Each instance has its own random number generator. */
+    ddpg->rng = deepc_rng_split(deepc_random_generator());
+
     /* Action returned. */
     ddpg->action = malloc(actionSize * sizeof(double));
     
@@ -39,8 +43,9 @@ DDPG *ddpg_create(
     /* The MLPC library is used to construct the actor and the critic. */
     ddpg->actor = mlp_create(stateSize, actionSize, actorDepth, actorLayers, ACTIVATION_RELU, ACTIVATION_TANH, batchSize);
     ddpg->critic = mlp_create(actionSize + stateSize, 1, criticDepth, criticLayers, ACTIVATION_RELU, ACTIVATION_LINEAR, batchSize);
-    ddpg->actorTarget = mlp_clone(ddpg->actor);
-    ddpg->criticTarget = mlp_clone(ddpg->critic);
+    /* The target networks are never trained, so they need no training buffers. */
+    ddpg->actorTarget = mlp_clone_inference(ddpg->actor);
+    ddpg->criticTarget = mlp_clone_inference(ddpg->critic);
 
     /* Initialize the Adam optimizers. */
     ddpg->actorAdam = adam_create(ddpg->actor);
@@ -55,20 +60,70 @@ DDPG *ddpg_create(
     /* Initialize batch capacity. */
     ddpg->batchSize = batchSize;
     ddpg->batchIndices = malloc(batchSize * sizeof(int));
+    ddpg->batchSteps = 1;
 
     /* The memory stores the current state, action, reward, next state, and the terminal flag. */
-    ddpg->memory = matrix_create(memorySize, actionSize + 2 * stateSize + 2);
-    ddpg->memorySize = memorySize;  
-    ddpg->memoryUsed = 0;
-    ddpg->memoryIdx = 0;
+    ddpg->replay = replay;
+    ddpg->observation = malloc((actionSize + stateSize) * sizeof(Scalar));
+
+    /* The batch is gathered from the memory directly into these matrices and the network inputs. */
+    ddpg->actorTargetInput = matrix_create(batchSize, stateSize);
+    ddpg->criticTargetInput = matrix_create(batchSize, actionSize + stateSize);
+    ddpg->batchActions = matrix_create(batchSize, actionSize);
+    ddpg->batchRewards = matrix_create(batchSize, 1);
+    ddpg->batchTerminals = matrix_create(batchSize, 1);
+    ddpg->batchWeights = matrix_create(batchSize, 1);
 
     /* Last observed state. */
-    ddpg->lastState = malloc(ddpg->stateSize * sizeof(double));
+    ddpg->lastState = malloc(ddpg->stateSize * sizeof(Scalar));
     ddpg->lastStateValid = 0;
 
+    /* The buffers of the batched functions are allocated by their first call. */
+    ddpg->envCount = 0;
+    ddpg->envStates = NULL;
+    ddpg->envStateValid = NULL;
+    ddpg->envObservations = NULL;
+    ddpg->envInput = (Matrix){ 0, 0, NULL };
+    ddpg->envContext = NULL;
+    ddpg->envActions = NULL;
+
     return ddpg;
 }
 
+DDPG *ddpg_create(
+    int stateSize,
+    int actionSize,
+    double *noise,
+    int actorDepth,
+    int *actorLayers,
+    int criticDepth,
+    int *criticLayers,
+    int memorySize,
+    int batchSize)
+{
+    Replay *replay = replay_create(memorySize, stateSize, actionSize);
+    return ddpg_create_with_replay(replay, stateSize, actionSize, noise, actorDepth, actorLayers, criticDepth, criticLayers, batchSize);
+}
+
+DDPG *ddpg_create_mapped(
+    const char *filename,
+    int stateSize,
+    int actionSize,
+    double *noise,
+    int actorDepth,
+    int *actorLayers,
+    int criticDepth,
+    int *criticLayers,
+    int memorySize,
+    int batchSize)
+{
+    Replay *replay = replay_create_mapped(filename, memorySize, stateSize, actionSize);
+    if (replay == NULL)
+        return NULL;
+
+    return ddpg_create_with_replay(replay, stateSize, actionSize, noise, actorDepth, actorLayers, criticDepth, criticLayers, batchSize);
+}
+
 void ddpg_destroy(DDPG *ddpg)
 {
     free(ddpg->action);
@@ -90,107 +145,202 @@ void ddpg_destroy(DDPG *ddpg)
         free(ddpg->noise);
 
     free(ddpg->batchIndices);
-    matrix_destroy(ddpg->memory);
-    
+    replay_destroy(ddpg->replay);
+    free(ddpg->observation);
+
+    matrix_destroy(ddpg->actorTargetInput);
+    matrix_destroy(ddpg->criticTargetInput);
+    matrix_destroy(ddpg->batchActions);
+    matrix_destroy(ddpg->batchRewards);
+    matrix_destroy(ddpg->batchTerminals);
+    matrix_destroy(ddpg->batchWeights);
+
     free(ddpg->lastState);
 
+    free(ddpg->envStates);
+    free(ddpg->envStateValid);
+    free(ddpg->envObservations);
+    matrix_destroy(ddpg->envInput);
+    if (ddpg->envContext != NULL)
+        mlp_context_destroy(ddpg->envContext);
+    free(ddpg->envActions);
+
     free(ddpg);
 }
 
-void ddpg_data_copy(double *dst, double *src, int length)
+void ddpg_data_copy(Scalar *dst, Scalar *src, int length)
 {
     for (int i = 0; i < length; i++)
         *(dst++) = *(src++);
 }
 
+/* Copies the user provided values, converting them to the element type of the library. */
+void ddpg_data_import(Scalar *dst, double *src, int length)
+{
+    for (int i = 0; i < length; i++)
+        *(dst++) = (Scalar)*(src++);
+}
+
 void ddpg_observe(DDPG *ddpg, double *action, double reward, double *state, int terminal)
 {
     /* If no state has yet been observed, just store the state. */
     if (!ddpg->lastStateValid)
     {
-        ddpg_data_copy(ddpg->lastState, state, ddpg->stateSize);
+        ddpg_data_import(ddpg->lastState, state, ddpg->stateSize);
         ddpg->lastStateValid = 1;
         return;
     }
 
-    /* Copy the given data to the observation memory. */
-    int col = 0;
-    ddpg_data_copy(&MATRIX(ddpg->memory, ddpg->memoryIdx, 0), ddpg->lastState, ddpg->stateSize);
-    ddpg_data_copy(&MATRIX(ddpg->memory, ddpg->memoryIdx, (col += ddpg->stateSize)), action, ddpg->actionSize);
-    MATRIX(ddpg->memory, ddpg->memoryIdx, (col += ddpg->actionSize)) = reward;
-    ddpg_data_copy(&MATRIX(ddpg->memory, ddpg->memoryIdx, (col += 1)), state, ddpg->stateSize);
-    MATRIX(ddpg->memory, ddpg->memoryIdx, (col + ddpg->stateSize)) = (terminal > 0 ? 1.0 : 0.0);
+    /* Convert the given data and store it to the observation memory. */
+    Scalar *newAction = ddpg->observation;
+    Scalar *newState = ddpg->observation + ddpg->actionSize;
+    ddpg_data_import(newAction, action, ddpg->actionSize);
+    ddpg_data_import(newState, state, ddpg->stateSize);
+    replay_add(ddpg->replay, ddpg->lastState, newAction, reward, newState, terminal);
 
     /* Store the given state as the last observed state. */
-    ddpg_data_copy(ddpg->lastState, state, ddpg->stateSize);
-
-    /* Increase the record index and memory size. */
-    ddpg->memoryIdx = (ddpg->memoryIdx + 1) % ddpg->memorySize;
-    if (ddpg->memoryUsed < ddpg->memorySize)
-        ddpg->memoryUsed++;
+    ddpg_data_copy(ddpg->lastState, newState, ddpg->stateSize);
 }
 
-double *ddpg_action(DDPG *ddpg, double *state)
+void ddpg_action_output(DDPG *ddpg, DeepcRng *rng, const Scalar *output, double *action)
 {
-    /* The actor expects a batch, but we only need to process one instance. We
-       use only the first sample in the batch and set the rest to 0. */
-    matrix_clear(ddpg->actorInput);
-    ddpg_data_copy(ddpg->actorInput.data, state, ddpg->stateSize);
-    Matrix action = mlp_feedforward(ddpg->actor, ddpg->actorInput);
-
-    /* Copy the resulting action to the DDPG structure. */
     for (int i = 0; i < ddpg->actionSize; i++)
     {
-        ddpg->action[i] = MATRIX(action, 0, i);
+        action[i] = output[i];
 
         /* If action noise is set, apply it to the individual output signals. */
         if (ddpg->noise != NULL)
         {
-            ddpg->action[i] += deepc_random_double(-ddpg->noise[i], ddpg->noise[i]);
+            action[i] += deepc_rng_double(rng, -ddpg->noise[i], ddpg->noise[i]);
 
             /* Clip the action to interval [-1, 1]. */
-            if (ddpg->action[i] > 1)
-                ddpg->action[i] = 1;
-            else if (ddpg->action[i] < -1)
-                ddpg->action[i] = -1;
+            if (action[i] > 1)
+                action[i] = 1;
+            else if (action[i] < -1)
+                action[i] = -1;
         }
     }
+}
+
+double *ddpg_action(DDPG *ddpg, double *state)
+{
+    /* Only one instance is processed, so the actor is given a batch of one row. */
+    Matrix input = matrix_rows(ddpg->actorInput, 0, 1);
+    ddpg_data_import(input.data, state, ddpg->stateSize);
+    Matrix action = mlp_feedforward_single(ddpg->actor, input);
+
+    /* Copy the resulting action to the DDPG structure. */
+    ddpg_action_output(ddpg, &ddpg->rng, action.data, ddpg->action);
 
     return ddpg->action;
 }
 
-void ddpg_train(DDPG *ddpg, double gamma)
+/* Makes room for `n` environments in the buffers of the batched functions, keeping the stored states. */
+static void ddpg_reserve_environments(DDPG *ddpg, int n)
 {
-    /* If not enough samples in memory, do nothing. */
-    if (ddpg->memoryUsed < ddpg->batchSize)
+    if (n <= ddpg->envCount)
         return;
 
-    /* Select a random batch. */
-    for (int i = 0; i < ddpg->batchSize; i++)
-        ddpg->batchIndices[i] = deepc_random_int(0, ddpg->memoryUsed - 1);
+    ddpg->envStates = realloc(ddpg->envStates, (size_t)n * ddpg->stateSize * sizeof(Scalar));
+    ddpg->envStateValid = realloc(ddpg->envStateValid, n * sizeof(int));
+    for (int e = ddpg->envCount; e < n; e++)
+        ddpg->envStateValid[e] = 0;
 
-    /* Train the actor. */
-    
-    /* Set the input states for the actor. */
-    for (int i = 0; i < ddpg->batchSize; i++)
-        ddpg_data_copy(&MATRIX(ddpg->actorInput, i, 0), &MATRIX(ddpg->memory, ddpg->batchIndices[i], 0), ddpg->stateSize);
+    free(ddpg->envObservations);
+    ddpg->envObservations = malloc((size_t)n * (ddpg->actionSize + ddpg->stateSize) * sizeof(Scalar));
+
+    matrix_destroy(ddpg->envInput);
+    ddpg->envInput = matrix_create(n, ddpg->stateSize);
+    if (ddpg->envContext != NULL)
+        mlp_context_destroy(ddpg->envContext);
+    ddpg->envContext = mlp_context_create(ddpg->actor, n);
+
+    free(ddpg->envActions);
+    ddpg->envActions = malloc((size_t)n * ddpg->actionSize * sizeof(double));
+
+    ddpg->envCount = n;
+}
+
+double *ddpg_action_batch(DDPG *ddpg, double *states, int n)
+{
+    ddpg_reserve_environments(ddpg, n);
+
+    /* All the environments are evaluated with a single pass through the actor. */
+    Matrix input = matrix_rows(ddpg->envInput, 0, n);
+    ddpg_data_import(input.data, states, n * ddpg->stateSize);
+    Matrix actions = mlp_context_feedforward(ddpg->actor, ddpg->envContext, input);
+
+    for (int e = 0; e < n; e++)
+        ddpg_action_output(ddpg, &ddpg->rng, &MATRIX(actions, e, 0), ddpg->envActions + (size_t)e * ddpg->actionSize);
+
+    return ddpg->envActions;
+}
+
+void ddpg_observe_batch(DDPG *ddpg, double *actions, double *rewards, double *states, int *terminals, int n)
+{
+    ddpg_reserve_environments(ddpg, n);
+
+    int stateSize = ddpg->stateSize;
+    int actionSize = ddpg->actionSize;
+
+    /* Convert the data of all the environments at once. */
+    Scalar *newActions = ddpg->envObservations;
+    Scalar *newStates = ddpg->envObservations + (size_t)n * actionSize;
+    ddpg_data_import(newActions, actions, n * actionSize);
+    ddpg_data_import(newStates, states, n * stateSize);
+
+    for (int e = 0; e < n; e++)
+    {
+        Scalar *lastState = ddpg->envStates + (size_t)e * stateSize;
+        Scalar *newState = newStates + (size_t)e * stateSize;
+
+        /* If no state has yet been observed in this environment, just store the state. */
+        if (ddpg->envStateValid[e])
+            replay_add(ddpg->replay, lastState, newActions + (size_t)e * actionSize, rewards[e], newState, terminals[e]);
+        else
+            ddpg->envStateValid[e] = 1;
+    }
+
+    /* Store the given states as the last observed states. */
+    ddpg_data_copy(ddpg->envStates, newStates, n * stateSize);
+}
+
+/*
+   A training step is a small task graph. After the batch has been gathered, it splits into two
+   independent branches: the actor branch trains the actor and evaluates the critic on the batch,
+   while the target branch evaluates the target networks on the next states. The branches join
+   before the critic errors, which need the results of both.
+*/
+#define DDPG_BRANCH_ACTOR 0
+#define DDPG_BRANCH_TARGET 1
+#define DDPG_BRANCHES 2
+
+/* The results of the branches of a training step. */
+typedef struct DDPGStep
+{
+    DDPG *ddpg;
+    Matrix criticOutput;
+    Matrix criticTargetOutput;
+} DDPGStep;
+
+/* Trains the actor on the batch states, then evaluates the critic on the batch actions. */
+static void ddpg_branch_actor(DDPGStep *step)
+{
+    DDPG *ddpg = step->ddpg;
 
     /* Get the proposed actions for the input states. */
     Matrix proposedActions = mlp_feedforward(ddpg->actor, ddpg->actorInput);
 
     /* Concatenate the proposed actions with batch states. */
     for (int i = 0; i < ddpg->batchSize; i++)
-    {
         ddpg_data_copy(&MATRIX(ddpg->criticInput, i, 0), &MATRIX(proposedActions, i, 0), ddpg->actionSize);
-        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, ddpg->actionSize), &MATRIX(ddpg->memory, ddpg->batchIndices[i], 0), ddpg->stateSize);
-    }
 
     /* Process the proposed actions through the critic. */
     mlp_feedforward(ddpg->critic, ddpg->criticInput);
 
-    /* Back-propagate the negative gradient through the critic. */
+    /* Back-propagate the negative gradient through the critic. Only the input errors of the actions are needed. */
     matrix_fill(ddpg->criticErrors, -1);
-    mlp_backpropagate(ddpg->critic, ddpg->criticErrors, LOSS_NONE);
+    mlp_backpropagate_flags(ddpg->critic, ddpg->criticErrors, LOSS_NONE, BACKPROP_INPUT, 0, ddpg->actionSize);
 
     /* Get the critic errors of the first layer and extract only those that correspond to actions. */
     Matrix errors = mlp_get_input_errors(ddpg->critic);
@@ -198,65 +348,179 @@ void ddpg_train(DDPG *ddpg, double gamma)
         ddpg_data_copy(&MATRIX(ddpg->actorErrors, i, 0), &MATRIX(errors, i, 0), ddpg->actionSize);
 
     /* Continue the back-propagation through the actor. */
-    mlp_backpropagate(ddpg->actor, ddpg->actorErrors, LOSS_NONE);
+    mlp_backpropagate_flags(ddpg->actor, ddpg->actorErrors, LOSS_NONE, BACKPROP_PARAMETERS, 0, 0);
 
     /* Optimize the actor */
     adam_optimize(ddpg->actor, ddpg->actorAdam);
 
-    /* Train the critic. */
-
-    /* Feed the batch actions and states to the critic. */
+    /* Feed the batch actions and states to the critic. The state columns are already in place. */
     for (int i = 0; i < ddpg->batchSize; i++)
-    {
-        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, 0), &MATRIX(ddpg->memory, ddpg->batchIndices[i], ddpg->stateSize), ddpg->actionSize);
-        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, ddpg->actionSize), &MATRIX(ddpg->memory, ddpg->batchIndices[i], 0), ddpg->stateSize);
-    }
+        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, 0), &MATRIX(ddpg->batchActions, i, 0), ddpg->actionSize);
 
-    Matrix criticOutput = mlp_feedforward(ddpg->critic, ddpg->criticInput);
+    step->criticOutput = mlp_feedforward(ddpg->critic, ddpg->criticInput);
+}
+
+/* Evaluates the target critic on the next states and the actions that the target actor proposes for them. */
+static void ddpg_branch_target(DDPGStep *step)
+{
+    DDPG *ddpg = step->ddpg;
 
     /* Feed the next state batch to the target actor. */
-    for (int i = 0; i < ddpg->batchSize; i++)
-        ddpg_data_copy(&MATRIX(ddpg->actorInput, i, 0), &MATRIX(ddpg->memory, ddpg->batchIndices[i], (ddpg->stateSize + ddpg->actionSize + 1)), ddpg->stateSize);
-    
-    Matrix actorTargetOutput = mlp_feedforward(ddpg->actorTarget, ddpg->actorInput);
+    Matrix actorTargetOutput = mlp_feedforward(ddpg->actorTarget, ddpg->actorTargetInput);
 
     /* Concatenate target actions with the next state batch and feed it to the target critic. */
     for (int i = 0; i < ddpg->batchSize; i++)
+        ddpg_data_copy(&MATRIX(ddpg->criticTargetInput, i, 0), &MATRIX(actorTargetOutput, i, 0), ddpg->actionSize);
+
+    step->criticTargetOutput = mlp_feedforward(ddpg->criticTarget, ddpg->criticTargetInput);
+}
+
+static void ddpg_branch(void *arg, int index, int count)
+{
+    if (index == DDPG_BRANCH_ACTOR)
+        ddpg_branch_actor(arg);
+    else
+        ddpg_branch_target(arg);
+}
+
+/* Makes one training step on the batch selected into `indices`, with the importance-sampling `weights`. */
+static void ddpg_train_batch(DDPG *ddpg, double gamma, const int *indices, const Scalar *weights)
+{
+    /*
+       Gather the batch in a single pass. The states go to the actor input and the state columns
+       of the critic input, the next states to the inputs of the target networks.
+    */
+    int criticColumns = ddpg->actionSize + ddpg->stateSize;
+    ReplayBatch batch = {
+        .states = {
+            { ddpg->actorInput.data, ddpg->stateSize },
+            { &MATRIX(ddpg->criticInput, 0, ddpg->actionSize), criticColumns } },
+        .actions = { ddpg->batchActions.data, ddpg->actionSize },
+        .rewards = { ddpg->batchRewards.data, 1 },
+        .nextStates = {
+            { ddpg->actorTargetInput.data, ddpg->stateSize },
+            { &MATRIX(ddpg->criticTargetInput, 0, ddpg->actionSize), criticColumns } },
+        .terminals = { ddpg->batchTerminals.data, 1 } };
+    replay_gather(ddpg->replay, indices, ddpg->batchSize, &batch);
+
+    /*
+       The branches run on two threads of the worker pool, unless the products of the networks
+       are large enough to be split among the threads of the pool themselves. Either way, each
+       product is split in the same way, so the results do not depend on the choice.
+    */
+    DDPGStep step = { ddpg };
+    if (!mlp_is_parallel(ddpg->actor, ddpg->batchSize) && !mlp_is_parallel(ddpg->critic, ddpg->batchSize))
+        mlp_run_parallel(ddpg_branch, &step, DDPG_BRANCHES);
+    else
     {
-        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, 0), &MATRIX(actorTargetOutput, i, 0), ddpg->actionSize);
-        ddpg_data_copy(&MATRIX(ddpg->criticInput, i, ddpg->actionSize), &MATRIX(ddpg->memory, ddpg->batchIndices[i], (ddpg->stateSize + ddpg->actionSize + 1)), ddpg->stateSize);
+        ddpg_branch_actor(&step);
+        ddpg_branch_target(&step);
     }
 
-    Matrix CriticTargetOutput = mlp_feedforward(ddpg->criticTarget, ddpg->criticInput);
-
     /* Compute the critic errors using the Bellman equation. */
     for (int i = 0; i < ddpg->batchSize; i++)
     {
-        double reward = MATRIX(ddpg->memory, ddpg->batchIndices[i], (ddpg->stateSize + ddpg->actionSize));
-        double terminal = MATRIX(ddpg->memory, ddpg->batchIndices[i], (2 * ddpg->stateSize + ddpg->actionSize + 1));
+        double reward = MATRIX(ddpg->batchRewards, i, 0);
+        double terminal = MATRIX(ddpg->batchTerminals, i, 0);
 
         if (terminal > 0)
-            MATRIX(ddpg->criticErrors, i, 0) = MATRIX(criticOutput, i, 0);
+            MATRIX(ddpg->criticErrors, i, 0) = MATRIX(step.criticOutput, i, 0);
         else
-            MATRIX(ddpg->criticErrors, i, 0) = MATRIX(criticOutput, i, 0) - (reward + gamma * MATRIX(CriticTargetOutput, i, 0));
+            MATRIX(ddpg->criticErrors, i, 0) = MATRIX(step.criticOutput, i, 0) - (reward + gamma * MATRIX(step.criticTargetOutput, i, 0));
+    }
+
+    /* With prioritized replay, the errors set the new priorities and are scaled by the importance-sampling weights. */
+    if (ddpg->replay->tree != NULL)
+    {
+        replay_update_priorities(ddpg->replay, indices, ddpg->criticErrors.data, ddpg->batchSize);
+        for (int i = 0; i < ddpg->batchSize; i++)
+            MATRIX(ddpg->criticErrors, i, 0) *= weights[i];
     }
 
     /* Backpropagate critic errors. */
-    mlp_backpropagate(ddpg->critic, ddpg->criticErrors, LOSS_NONE);
+    mlp_backpropagate_flags(ddpg->critic, ddpg->criticErrors, LOSS_NONE, BACKPROP_PARAMETERS, 0, 0);
 
     /* Optimize the critic. */
     adam_optimize(ddpg->critic, ddpg->criticAdam);
 }
 
+void ddpg_train(DDPG *ddpg, double gamma)
+{
+    /* If not enough samples in memory, do nothing. */
+    if (ddpg->replay->size < ddpg->batchSize)
+        return;
+
+    /* Select a random batch. */
+    replay_sample(ddpg->replay, &ddpg->rng, ddpg->batchIndices, ddpg->batchWeights.data, ddpg->batchSize);
+
+    ddpg_train_batch(ddpg, gamma, ddpg->batchIndices, ddpg->batchWeights.data);
+}
+
+/* Makes room for the indices and the weights of `steps` batches, keeping none of their contents. */
+static void ddpg_reserve_steps(DDPG *ddpg, int steps)
+{
+    if (steps <= ddpg->batchSteps)
+        return;
+
+    free(ddpg->batchIndices);
+    ddpg->batchIndices = malloc((size_t)steps * ddpg->batchSize * sizeof(int));
+    matrix_destroy(ddpg->batchWeights);
+    ddpg->batchWeights = matrix_create(steps * ddpg->batchSize, 1);
+
+    ddpg->batchSteps = steps;
+}
+
+void ddpg_train_steps(DDPG *ddpg, double gamma, int k)
+{
+    if (ddpg->replay->size < ddpg->batchSize || k <= 0)
+        return;
+
+    ddpg_reserve_steps(ddpg, k);
+    int batchSize = ddpg->batchSize;
+
+    /* Select all the batches up front. */
+    for (int step = 0; step < k; step++)
+        replay_sample(ddpg->replay, &ddpg->rng, ddpg->batchIndices + (size_t)step * batchSize,
+            ddpg->batchWeights.data + (size_t)step * batchSize, batchSize);
+
+    for (int step = 0; step < k; step++)
+        ddpg_train_batch(ddpg, gamma, ddpg->batchIndices + (size_t)step * batchSize,
+            ddpg->batchWeights.data + (size_t)step * batchSize);
+}
+
 void ddpg_update_target_networks(DDPG *ddpg)
 {
-    mlp_copy(ddpg->actorTarget, ddpg->actor);
-    mlp_copy(ddpg->criticTarget, ddpg->critic);
+    mlp_copy_params(ddpg->actorTarget, ddpg->actor);
+    mlp_copy_params(ddpg->criticTarget, ddpg->critic);
+}
+
+void ddpg_soft_update_target_networks(DDPG *ddpg, double tau)
+{
+    mlp_soft_update(ddpg->actorTarget, ddpg->actor, tau);
+    mlp_soft_update(ddpg->criticTarget, ddpg->critic, tau);
+}
+
+void ddpg_prioritize(DDPG *ddpg, double alpha, double beta)
+{
+    replay_prioritize(ddpg->replay, alpha, beta);
+}
+
+void ddpg_seed(DDPG *ddpg, uint64_t seed)
+{
+    deepc_rng_seed(&ddpg->rng, seed);
 }
 
 void ddpg_new_episode(DDPG *ddpg)
 {
     ddpg->lastStateValid = 0;
+    for (int e = 0; e < ddpg->envCount; e++)
+        ddpg->envStateValid[e] = 0;
+}
+
+void ddpg_new_episode_env(DDPG *ddpg, int env)
+{
+    if (env < ddpg->envCount)
+        ddpg->envStateValid[env] = 0;
 }
 
 int ddpg_save_policy(DDPG *ddpg, const char *filename)
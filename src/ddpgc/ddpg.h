@@ -8,7 +8,7 @@
  * structure called DDPG that represents one instance of the DDPG algorithm.
  */
 
-#include "mlpc.h"
+#include "replay.h"
 
 /**
  * This structure contains all the parameters of a DDPG instance, its current
@@ -52,12 +52,14 @@ typedef struct DDPG
     MLP *critic;
 
     /**
-     * The target actor neural network.
+     * The target actor neural network. It is only evaluated, so it is
+     * created for inference only.
      */
     MLP *actorTarget;
 
     /**
-     * The target critic neural network.
+     * The target critic neural network. It is only evaluated, so it is
+     * created for inference only.
      */
     MLP *criticTarget;
 
@@ -72,14 +74,14 @@ typedef struct DDPG
     Adam *criticAdam;
 
     /**
-     * A preallocated matrix that is used as a batch input for either the
-     * actor or the target actor.
+     * A preallocated matrix that is used as a batch input for the actor. It
+     * is filled with the states of the batch.
      */
     Matrix actorInput;
 
     /**
-     * A preallocated matrix that is used as a batch input for either the
-     * critic or the target critic.
+     * A preallocated matrix that is used as a batch input for the critic.
+     * Its state columns are filled with the states of the batch.
      */
     Matrix criticInput;
 
@@ -107,34 +109,64 @@ typedef struct DDPG
     int *batchIndices;
 
     /**
-     * The size of the memory that stores the observations. The memory is
+     * The number of batches whose indices and importance-sampling weights
+     * (`batchIndices` and `batchWeights`) can be held at once, one batch after
+     * another. `ddpg_train` uses one batch, while `ddpg_train_steps` selects
+     * all of its batches up front. The buffers only grow when more steps are
+     * requested.
+     */
+    int batchSteps;
+
+    /**
+     * The random number generator used for the action noise and the batch
+     * selection. It is split from the default generator of the creating
+     * thread, and can be seeded with `ddpg_seed`.
+     */
+    DeepcRng rng;
+
+    /**
+     * The replay memory that stores the observations. An observation is a
+     * tuple (state, action, reward, next state, terminal). The memory is
      * preallocated upon DDPG creation.
      */
-    int memorySize;
+    Replay *replay;
+
+    /**
+     * A preallocated matrix that is used as a batch input for the target
+     * actor. It is filled with the next states of the batch.
+     */
+    Matrix actorTargetInput;
 
     /**
-     * The number of records (observations) contained in the memory.
+     * A preallocated matrix that is used as a batch input for the target
+     * critic. Its state columns are filled with the next states of the batch.
      */
-    int memoryUsed;
+    Matrix criticTargetInput;
 
     /**
-     * The index of the next observation slot to be written in the memory. If
-     * the memory is full, the oldest record is overwritten.
+     * Preallocated matrices that receive the actions, the rewards and the
+     * terminal flags of the batch.
      */
-    int memoryIdx;
+    Matrix batchActions;
+    Matrix batchRewards;
+    Matrix batchTerminals;
 
     /**
-     * The preallocated memory to store observations. An observations is defined
-     * as a tuple (state, action, reward, next state, terminal). The reward
-     * and the terminal flag each take up one variable of type double. The size
-     * of one observation is therefore equal to `2 * stateSize + actionSize + 2`.
+     * A preallocated matrix that receives the importance-sampling weights of
+     * the batch, which scale the critic errors when the replay is prioritized.
      */
-    Matrix memory;
+    Matrix batchWeights;
+
+    /**
+     * A preallocated array to which the observed action and state are
+     * converted before being stored. Size: `actionSize + stateSize`.
+     */
+    Scalar *observation;
 
     /**
      * A preallocated array that stores the last observed state.
      */
-    double *lastState;
+    Scalar *lastState;
 
     /**
      * A flag that determines if the `lastState` variable stores a valid state.
@@ -142,6 +174,44 @@ typedef struct DDPG
      * observation has been made.
      */
     int lastStateValid;
+
+    /**
+     * The number of environments that the buffers of the batched functions
+     * `ddpg_action_batch` and `ddpg_observe_batch` can hold. The buffers are
+     * allocated by the first call and only grow when more environments are
+     * given, so with a fixed number of environments there are no further
+     * allocations.
+     */
+    int envCount;
+
+    /**
+     * The last observed state of each environment, and the flags that
+     * determine if they are valid, as with `lastState` and `lastStateValid`.
+     * Format: (envCount × stateSize)
+     */
+    Scalar *envStates;
+    int *envStateValid;
+
+    /**
+     * A preallocated array to which the observed actions and states of all
+     * the environments are converted before being stored.
+     * Size: `envCount * (actionSize + stateSize)`
+     */
+    Scalar *envObservations;
+
+    /**
+     * The input of the actor for all the environments, and the feedforward
+     * workspace that evaluates it without disturbing the training buffers of
+     * the actor.
+     */
+    Matrix envInput;
+    MLPContext *envContext;
+
+    /**
+     * The actions returned by `ddpg_action_batch`.
+     * Format: (envCount × actionSize)
+     */
+    double *envActions;
 } DDPG;
 
 /**
@@ -189,6 +259,32 @@ DDPG *ddpg_create(
     int memorySize,
     int batchSize);
 
+/**
+ * Creates a DDPG on heap whose experience memory is kept in the file
+ * `filename`, which is mapped into memory. The memory can therefore be larger
+ * than the physical memory of the computer, and the observations survive the
+ * end of the program: if the file holds the memory of a DDPG with the same
+ * `stateSize`, `actionSize` and `memorySize`, its observations are used for
+ * training. The other parameters are the same as with `ddpg_create`. A DDPG
+ * created with this function must eventually be destroyed by calling
+ * `ddpg_destroy`, which keeps the file.
+ *
+ * \returns The pointer to a newly created and initialized DDPG structure, or
+ * NULL if the file could not be created or mapped, or if it holds a memory of
+ * other dimensions.
+ */
+DDPG *ddpg_create_mapped(
+    const char *filename,
+    int stateSize,
+    int actionSize,
+    double *noise,
+    int actorDepth,
+    int *actorLayers,
+    int criticDepth,
+    int *criticLayers,
+    int memorySize,
+    int batchSize);
+
 /**
  * Frees the memory allocated on the heap by the given DDPG. After being
  * destroyed, the DDPG structure should not be used anymore.
@@ -226,6 +322,28 @@ void ddpg_observe(DDPG *ddpg, double *action, double reward, double *state, int
  */
 double *ddpg_action(DDPG *ddpg, double *state);
 
+/**
+ * Returns the actions that the given `ddpg` proposes to execute in the states
+ * of `n` environments at once, with a single evaluation of the actor. The
+ * `states` array holds the `n` states one after another, and the action noise
+ * is drawn independently for each environment.
+ *
+ * \returns An array of the `n` actions one after another, each of length
+ * `actionSize`. The array is valid until the next call of this function.
+ */
+double *ddpg_action_batch(DDPG *ddpg, double *states, int n);
+
+/**
+ * Passes the observations of `n` environments to the DDPG at once, like
+ * calling `ddpg_observe` for each of them. The arrays hold the values of the
+ * environments one after another: `actions` (n × `actionSize`), `rewards` (n),
+ * `states` (n × `stateSize`) and `terminals` (n). The last observed state is
+ * stored separately for each environment, so the first observation of an
+ * environment, or the first one after `ddpg_new_episode_env`, only stores its
+ * state.
+ */
+void ddpg_observe_batch(DDPG *ddpg, double *actions, double *rewards, double *states, int *terminals, int n);
+
 /**
  * Train the given `ddpg` on one randomly selected batch from the memory. The
  * size of the batch is determined by the `batchSize` parameter, given during
@@ -234,16 +352,65 @@ double *ddpg_action(DDPG *ddpg, double *state);
 void ddpg_train(DDPG *ddpg, double gamma);
 
 /**
- * Updates the target actor and critic networks.
+ * Trains the given `ddpg` on `k` randomly selected batches, one training step
+ * per batch, which suits high update-to-data ratios. All the batches are
+ * selected before the first step, so with uniform sampling the result is the
+ * same as that of calling `ddpg_train` `k` times, while with prioritized
+ * replay the batches are selected with the priorities from before the first
+ * step.
+ */
+void ddpg_train_steps(DDPG *ddpg, double gamma, int k);
+
+/**
+ * Updates the target actor and critic networks by copying the weights and
+ * biases of the actor and the critic.
  */
 void ddpg_update_target_networks(DDPG *ddpg);
 
+/**
+ * Moves the weights and biases of the target actor and critic networks towards
+ * those of the actor and the critic by the fraction `tau`:
+ *
+ *     target = tau * online + (1 - tau) * target
+ *
+ * The update is cheap enough to be called after every training step, with a
+ * small `tau` such as 0.005.
+ */
+void ddpg_soft_update_target_networks(DDPG *ddpg, double tau);
+
+/**
+ * Turns on prioritized experience replay for the given `ddpg`. The training
+ * batches are then sampled in proportion to the priorities of the
+ * observations, which are set from the critic errors of the previous training
+ * steps. `alpha` determines how strongly the priorities affect the sampling
+ * (0 gives uniform sampling), and `beta` how much of the resulting bias is
+ * corrected by weighting the critic errors (1 corrects it fully). The function
+ * can be called again to change `beta` during training.
+ */
+void ddpg_prioritize(DDPG *ddpg, double alpha, double beta);
+
+/**
+ * Seeds the random number generator of the given `ddpg`, which selects the
+ * training batches and the action noise. Together with a seeded MLP
+ * initialization (see `deepc_random_seed`), this makes training runs
+ * reproducible.
+ */
+void ddpg_seed(DDPG *ddpg, uint64_t seed);
+
 /**
  * Signals that a new episode has been started. This invalidates the currently
- * stored state.
+ * stored state, and the stored states of all the environments of the batched
+ * functions.
  */
 void ddpg_new_episode(DDPG *ddpg);
 
+/**
+ * Signals that a new episode has been started in the environment `env` of the
+ * batched functions (see `ddpg_observe_batch`). This invalidates the stored
+ * state of that environment only.
+ */
+void ddpg_new_episode_env(DDPG *ddpg, int env);
+
 /**
  * Store the trained policy to a file. This saves the weights and biases
  * of the actor and the critic, but no other training data.
@@ -260,4 +427,21 @@ int ddpg_save_policy(DDPG *ddpg, const char *filename);
  * 
  * \returns 0 if successful, -1 otherwise.
  */
-int ddpg_load_policy(DDPG *ddpg, const char *filename);
\ No newline at end of file
+int ddpg_load_policy(DDPG *ddpg, const char *filename);
+
+/**
+ * Copies `length` values from `src` to `dst`.
+ */
+void ddpg_data_copy(Scalar *dst, Scalar *src, int length);
+
+/**
+ * Copies `length` values from the user provided array `src` to `dst`,
+ * converting them to the element type of the library.
+ */
+void ddpg_data_import(Scalar *dst, double *src, int length);
+
+/**
+ * Copies the `output` of the actor to `action`, applying the action noise of
+ * the given `ddpg` if it is set, drawn from the generator `rng`.
+ */
+void ddpg_action_output(DDPG *ddpg, DeepcRng *rng, const Scalar *output, double *action);
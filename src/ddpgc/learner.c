@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include "learner.h"
+
+/* Stores all the completed transitions of the queue to the replay memory. Returns their number. */
+static int learner_store(Learner *learner)
+{
+    DDPG *ddpg = learner->ddpg;
+    int stateSize = ddpg->stateSize;
+    int actionSize = ddpg->actionSize;
+
+    size_t head = atomic_load_explicit(&learner->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&learner->tail, memory_order_relaxed);
+
+    /* The queue is deepest right before it is emptied. */
+    int depth = (int)(tail - head);
+    if (depth > atomic_load_explicit(&learner->maxQueueDepth, memory_order_relaxed))
+        atomic_store_explicit(&learner->maxQueueDepth, depth, memory_order_relaxed);
+
+    int stored = 0;
+    for (;;)
+    {
+        LearnerSlot *slot = &learner->slots[head & (learner->capacity - 1)];
+
+        /* The slot may be claimed, but the actor has not finished writing it yet. */
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + 1)
+            break;
+
+        Scalar *t = learner->transitions + (head & (learner->capacity - 1)) * learner->stride;
+        replay_add(ddpg->replay, t, t + stateSize, t[stateSize + actionSize], t + stateSize + actionSize + 1,
+            t[2 * stateSize + actionSize + 1] > 0);
+
+        /* The slot is free for the position one lap ahead. */
+        atomic_store_explicit(&slot->sequence, head + learner->capacity, memory_order_release);
+        head++;
+        stored++;
+    }
+
+    atomic_store_explicit(&learner->head, head, memory_order_relaxed);
+    return stored;
+}
+
+/* Checks whether the replay memory holds a batch and the update-to-data ratio allows another step. */
+static int learner_may_train(Learner *learner)
+{
+    if (learner->ddpg->replay->size < learner->ddpg->batchSize)
+        return 0;
+
+    if (learner->ratio <= 0)
+        return 1;
+
+    long long steps = atomic_load_explicit(&learner->steps, memory_order_relaxed);
+    size_t stored = atomic_load_explicit(&learner->head, memory_order_relaxed);
+    return steps < learner->ratio * stored;
+}
+
+/* Copies the weights of the actor for the acting threads, unless one of them is copying the previous ones. */
+static void learner_publish(Learner *learner)
+{
+    if (mtx_trylock(&learner->policyMutex) != thrd_success)
+        return;
+
+    mlp_copy_params(learner->policy, learner->ddpg->actor);
+    atomic_fetch_add(&learner->version, 1);
+    mtx_unlock(&learner->policyMutex);
+}
+
+static int learner_run(void *arg)
+{
+    Learner *learner = arg;
+    struct timespec idle = { 0, LEARNER_IDLE * 1000 };
+
+    while (!atomic_load(&learner->stopping))
+    {
+        int stored = learner_store(learner);
+
+        if (learner_may_train(learner))
+        {
+            ddpg_train(learner->ddpg, learner->gamma);
+            ddpg_soft_update_target_networks(learner->ddpg, learner->tau);
+            atomic_fetch_add_explicit(&learner->steps, 1, memory_order_relaxed);
+            learner_publish(learner);
+        }
+        else if (stored == 0)
+            thrd_sleep(&idle, NULL);
+    }
+
+    return 0;
+}
+
+Learner *learner_create(DDPG *ddpg, double gamma, double tau, double ratio, int capacity)
+{
+    int slots = 1;
+    while (slots < capacity)
+        slots *= 2;
+
+    /* A transition takes the same values as a record of the replay memory. */
+    int values = 2 * ddpg->stateSize + ddpg->actionSize + 2;
+    int lineValues = 64 / sizeof(Scalar);
+
+    Learner *learner = malloc(sizeof(Learner));
+    learner->ddpg = ddpg;
+    learner->gamma = gamma;
+    learner->tau = tau;
+    learner->ratio = ratio;
+    learner->capacity = slots;
+    learner->stride = (values + lineValues - 1) / lineValues * lineValues;
+    learner->slots = replay_aligned_alloc(slots * sizeof(LearnerSlot));
+    learner->transitions = replay_aligned_alloc((size_t)slots * learner->stride * sizeof(Scalar));
+
+    for (int i = 0; i < slots; i++)
+        atomic_init(&learner->slots[i].sequence, i);
+    atomic_init(&learner->tail, 0);
+    atomic_init(&learner->head, 0);
+    atomic_init(&learner->dropped, 0);
+    atomic_init(&learner->steps, 0);
+    atomic_init(&learner->maxQueueDepth, 0);
+
+    /* The actors start from the current weights of the actor. */
+    learner->policy = mlp_clone_inference(ddpg->actor);
+    mtx_init(&learner->policyMutex, mtx_plain);
+    atomic_init(&learner->version, 1);
+    atomic_init(&learner->stopping, 0);
+
+    if (thrd_create(&learner->thread, learner_run, learner) != thrd_success)
+    {
+        atomic_store(&learner->stopping, 1);
+        learner_destroy(learner);
+        return NULL;
+    }
+
+    return learner;
+}
+
+void learner_destroy(Learner *learner)
+{
+    if (!atomic_load(&learner->stopping))
+    {
+        atomic_store(&learner->stopping, 1);
+        thrd_join(learner->thread, NULL);
+    }
+
+    /* The transitions still in the queue are kept for further training. */
+    learner_store(learner);
+
+    mtx_destroy(&learner->policyMutex);
+    mlp_destroy(learner->policy);
+    replay_aligned_free(learner->transitions);
+    replay_aligned_free(learner->slots);
+    free(learner);
+}
+
+void learner_get_stats(Learner *learner, LearnerStats *stats)
+{
+    size_t head = atomic_load(&learner->head);
+    size_t tail = atomic_load(&learner->tail);
+
+    stats->transitions = (long long)tail;
+    stats->dropped = atomic_load(&learner->dropped);
+    stats->steps = atomic_load(&learner->steps);
+    stats->updateToData = head > 0 ? (double)stats->steps / head : 0;
+    stats->queueDepth = tail > head ? (int)(tail - head) : 0;
+    stats->maxQueueDepth = atomic_load(&learner->maxQueueDepth);
+}
+
+LearnerActor *learner_actor_create(Learner *learner)
+{
+    DDPG *ddpg = learner->ddpg;
+
+    LearnerActor *actor = malloc(sizeof(LearnerActor));
+    actor->learner = learner;
+
+    mtx_lock(&learner->policyMutex);
+    actor->actor = mlp_clone_inference(learner->policy);
+    actor->version = atomic_load(&learner->version);
+    mtx_unlock(&learner->policyMutex);
+
+    actor->input = matrix_create(1, ddpg->stateSize);
+    actor->action = malloc(ddpg->actionSize * sizeof(double));
+
+    /* The generator of the DDPG belongs to the training thread, so the actor splits its own. */
+    actor->rng = deepc_rng_split(deepc_random_generator());
+
+    actor->lastState = malloc(ddpg->stateSize * sizeof(Scalar));
+    actor->lastStateValid = 0;
+
+    return actor;
+}
+
+void learner_actor_destroy(LearnerActor *actor)
+{
+    mlp_destroy(actor->actor);
+    matrix_destroy(actor->input);
+    free(actor->action);
+    free(actor->lastState);
+    free(actor);
+}
+
+double *learner_actor_action(LearnerActor *actor, double *state)
+{
+    Learner *learner = actor->learner;
+
+    /* Take the latest weights if they have been published since the last action. */
+    if (atomic_load(&learner->version) != actor->version)
+    {
+        mtx_lock(&learner->policyMutex);
+        mlp_copy_params(actor->actor, learner->policy);
+        actor->version = atomic_load(&learner->version);
+        mtx_unlock(&learner->policyMutex);
+    }
+
+    ddpg_data_import(actor->input.data, state, learner->ddpg->stateSize);
+    Matrix action = mlp_feedforward_single(actor->actor, actor->input);
+    ddpg_action_output(learner->ddpg, &actor->rng, action.data, actor->action);
+
+    return actor->action;
+}
+
+int learner_actor_observe(LearnerActor *actor, double *action, double reward, double *state, int terminal)
+{
+    Learner *learner = actor->learner;
+    int stateSize = learner->ddpg->stateSize;
+    int actionSize = learner->ddpg->actionSize;
+
+    /* If no state has yet been observed, just store the state. */
+    if (!actor->lastStateValid)
+    {
+        ddpg_data_import(actor->lastState, state, stateSize);
+        actor->lastStateValid = 1;
+        return 0;
+    }
+
+    /* Claim the slot at the tail, unless it still holds a transition from the previous lap. */
+    size_t position = atomic_load_explicit(&learner->tail, memory_order_relaxed);
+    LearnerSlot *slot;
+    for (;;)
+    {
+        slot = &learner->slots[position & (learner->capacity - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == position)
+        {
+            if (atomic_compare_exchange_weak_explicit(&learner->tail, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (sequence < position)
+        {
+            /* The queue is full. The state is kept, so the next transition starts from it. */
+            atomic_fetch_add_explicit(&learner->dropped, 1, memory_order_relaxed);
+            ddpg_data_import(actor->lastState, state, stateSize);
+            return -1;
+        }
+        else
+            position = atomic_load_explicit(&learner->tail, memory_order_relaxed);
+    }
+
+    /* Write the transition in the layout of the replay records and hand the slot to the learner. */
+    Scalar *t = learner->transitions + (position & (learner->capacity - 1)) * learner->stride;
+    ddpg_data_copy(t, actor->lastState, stateSize);
+    ddpg_data_import(t + stateSize, action, actionSize);
+    t[stateSize + actionSize] = (Scalar)reward;
+    ddpg_data_import(t + stateSize + actionSize + 1, state, stateSize);
+    t[2 * stateSize + actionSize + 1] = (Scalar)(terminal != 0);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    /* Store the given state as the last observed state. */
+    ddpg_data_copy(actor->lastState, t + stateSize + actionSize + 1, stateSize);
+    return 0;
+}
+
+void learner_actor_new_episode(LearnerActor *actor)
+{
+    actor->lastStateValid = 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * \file   learner.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Asynchronous training of a DDPG on its own thread
+ *
+ * When the environment is stepped and the DDPG is trained on the same thread,
+ * every gradient step waits for the simulator and every simulator step waits
+ * for the gradient step. A learner separates the two: it owns the DDPG and
+ * trains it continuously on its own thread, while any number of acting
+ * threads step their environments and pass the observed transitions to it.
+ *
+ * Each acting thread uses a `LearnerActor`, which holds its own copy of the
+ * actor network and its own random number generator. After each training
+ * step, the learner publishes the weights of the actor, and every actor
+ * copies them before its next action if they have changed. The published
+ * weights are guarded by a mutex, but the learner only tries to lock it, so
+ * the training never waits for the acting threads.
+ *
+ * The transitions are passed through a lock-free ring buffer with many
+ * producers and a single consumer. An acting thread claims a slot by
+ * advancing the tail of the ring with a compare-and-swap, writes the
+ * transition into it, and marks it as complete with the sequence number of
+ * the slot. The learner moves the completed transitions into the replay
+ * memory before every training step. When the ring is full, the transition
+ * is dropped rather than making the acting thread wait, and the drop is
+ * counted.
+ *
+ * The number of training steps per stored transition (the update-to-data
+ * ratio) can be limited. Without a limit, the learner trains as fast as it
+ * can and keeps one core busy.
+ *
+ * The learner is built on the C11 threads and atomics libraries.
+ */
+
+#include <stdatomic.h>
+#include <threads.h>
+#include "ddpg.h"
+
+/**
+ * The time in microseconds for which the learner sleeps when it has neither
+ * transitions to store nor training steps to make.
+ */
+#define LEARNER_IDLE 100
+
+/**
+ * The metrics of a learner, collected since its creation.
+ */
+typedef struct LearnerStats
+{
+    /**
+     * The number of transitions that have been queued by the actors.
+     */
+    long long transitions;
+
+    /**
+     * The number of transitions that have been dropped because the queue was
+     * full.
+     */
+    long long dropped;
+
+    /**
+     * The number of training steps that have been made.
+     */
+    long long steps;
+
+    /**
+     * The number of training steps per transition stored to the replay
+     * memory.
+     */
+    double updateToData;
+
+    /**
+     * The number of transitions currently waiting in the queue.
+     */
+    int queueDepth;
+
+    /**
+     * The largest number of transitions that were waiting in the queue at
+     * once.
+     */
+    int maxQueueDepth;
+} LearnerStats;
+
+/**
+ * A slot of the transition queue. The sequence number tells the state of the
+ * slot: it equals the position of the slot while the slot is free, and the
+ * position plus one when it holds a complete transition. The slots are padded
+ * to a cache line, so the actors writing neighbouring slots do not share one.
+ */
+typedef struct LearnerSlot
+{
+    atomic_size_t sequence;
+    char padding[64 - sizeof(atomic_size_t)];
+} LearnerSlot;
+
+/**
+ * Definition of a learner.
+ */
+typedef struct Learner
+{
+    /**
+     * The trained DDPG. It must not be used by other threads while the
+     * learner is running.
+     */
+    DDPG *ddpg;
+
+    /**
+     * The discount factor of the training.
+     */
+    double gamma;
+
+    /**
+     * The fraction by which the target networks are moved towards the actor
+     * and the critic after every training step (see
+     * `ddpg_soft_update_target_networks`).
+     */
+    double tau;
+
+    /**
+     * The largest number of training steps per stored transition, or 0 if the
+     * training is not limited.
+     */
+    double ratio;
+
+    /**
+     * The number of slots of the queue, a power of two.
+     */
+    int capacity;
+
+    /**
+     * The number of values between the starts of two transitions in the
+     * queue. The transitions are stored like the records of the replay
+     * memory, and padded to a whole number of cache lines.
+     */
+    int stride;
+
+    /**
+     * The slots of the queue and the transitions they hold.
+     * Format of `transitions`: (capacity × stride)
+     */
+    LearnerSlot *slots;
+    Scalar *transitions;
+
+    /**
+     * The positions of the next slot to be claimed by an actor and of the
+     * next slot to be stored by the learner. They only grow, and the slot of
+     * a position is the position modulo the capacity.
+     */
+    atomic_size_t tail;
+    atomic_size_t head;
+
+    /**
+     * The counters of the metrics that are not derived from the positions.
+     */
+    atomic_llong dropped;
+    atomic_llong steps;
+    atomic_int maxQueueDepth;
+
+    /**
+     * The published weights of the actor, the mutex that guards them, and
+     * their version, which changes with every publication.
+     */
+    MLP *policy;
+    mtx_t policyMutex;
+    atomic_llong version;
+
+    /**
+     * Set when the learner is being destroyed.
+     */
+    atomic_int stopping;
+
+    /**
+     * The training thread.
+     */
+    thrd_t thread;
+} Learner;
+
+/**
+ * The acting side of a learner, used by one acting thread.
+ */
+typedef struct LearnerActor
+{
+    /**
+     * The learner that receives the transitions.
+     */
+    Learner *learner;
+
+    /**
+     * The copy of the actor network, and the version of the published weights
+     * that it holds.
+     */
+    MLP *actor;
+    long long version;
+
+    /**
+     * A preallocated matrix that is used as the input of the actor.
+     */
+    Matrix input;
+
+    /**
+     * A preallocated array to store and return the action.
+     */
+    double *action;
+
+    /**
+     * The random number generator used for the action noise.
+     */
+    DeepcRng rng;
+
+    /**
+     * The last observed state, and the flag that determines if it is valid,
+     * as with `DDPG`.
+     */
+    Scalar *lastState;
+    int lastStateValid;
+} LearnerActor;
+
+/**
+ * Creates a learner for the given `ddpg` and starts its training thread. Each
+ * training step uses the discount factor `gamma` and moves the target networks
+ * by the fraction `tau`. If `ratio` is greater than 0, the learner makes at
+ * most `ratio` training steps per stored transition, otherwise it trains
+ * continuously. The queue holds `capacity` transitions, rounded up to a power
+ * of two. From the creation until the destruction of the learner, the `ddpg`
+ * must not be used by other threads. Every learner created with this function
+ * must eventually be destroyed by calling `learner_destroy`.
+ *
+ * \returns The newly created learner, or NULL if the training thread could not
+ * be started.
+ */
+Learner *learner_create(DDPG *ddpg, double gamma, double tau, double ratio, int capacity);
+
+/**
+ * Stops the training thread, stores the queued transitions to the replay
+ * memory and frees the memory allocated by the learner. The DDPG is kept and
+ * holds the trained networks. All the actors of the learner must be destroyed
+ * before.
+ */
+void learner_destroy(Learner *learner);
+
+/**
+ * Stores the current metrics of the learner to `stats`.
+ */
+void learner_get_stats(Learner *learner, LearnerStats *stats);
+
+/**
+ * Creates an actor of the given `learner`, to be used by one acting thread.
+ * Every actor created with this function must eventually be destroyed by
+ * calling `learner_actor_destroy`.
+ *
+ * \returns The newly created actor.
+ */
+LearnerActor *learner_actor_create(Learner *learner);
+
+/**
+ * Frees the memory allocated by the given actor.
+ */
+void learner_actor_destroy(LearnerActor *actor);
+
+/**
+ * Returns the action that the latest published actor network proposes to
+ * execute in the given `state`, with the action noise of the DDPG applied.
+ *
+ * \returns An array of output signals of length `actionSize`.
+ */
+double *learner_actor_action(LearnerActor *actor, double *state);
+
+/**
+ * Passes an observation to the learner, like `ddpg_observe`. The transition is
+ * queued without waiting.
+ *
+ * \returns 0 if the transition was queued or it was the first observation of
+ * an episode, -1 if it was dropped because the queue was full.
+ */
+int learner_actor_observe(LearnerActor *actor, double *action, double reward, double *state, int terminal);
+
+/**
+ * Signals that a new episode has been started, which invalidates the stored
+ * state of the actor.
+ */
+void learner_actor_new_episode(LearnerActor *actor);
@@ -0,0 +1,624 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include "replay.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__GNUC__)
+#define REPLAY_PREFETCH_LINE(address) __builtin_prefetch(address, 0, 3)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define REPLAY_PREFETCH_LINE(address) _mm_prefetch((const char *)(address), _MM_HINT_T0)
+#else
+#define REPLAY_PREFETCH_LINE(address)
+#endif
+
+/* The number of values in one 64-byte cache line. */
+#define REPLAY_LINE_VALUES (64 / (int)sizeof(Scalar))
+
+/* The number of transitions that descend the sum tree together. */
+#define REPLAY_GROUP 16
+
+/* The size of a memory page. The file header takes up one page, which keeps the records aligned to pages. */
+#define REPLAY_PAGE 4096
+#define REPLAY_HEADER_BYTES REPLAY_PAGE
+
+/* The size of the chunks in which the records are written back to a mapped file. */
+#define REPLAY_CHUNK_BYTES (1 << 20)
+
+/* The identification of a replay memory file. */
+#define REPLAY_MAGIC "DDPGCRM1"
+
+/* The header at the start of a replay memory file. */
+typedef struct ReplayHeader
+{
+    char magic[8];
+    int32_t scalarSize;
+    int32_t stateSize;
+    int32_t actionSize;
+    int32_t capacity;
+    int32_t stride;
+    int32_t size;
+    int32_t next;
+} ReplayHeader;
+
+struct ReplayFile
+{
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    char *base;
+    size_t bytes;
+    ReplayHeader *header;
+
+    /* The records are written back in chunks; the current chunk starts at this record. */
+    size_t chunkRecords;
+    size_t chunkStart;
+};
+
+/* The records and the sum tree are aligned to cache lines. */
+void *replay_aligned_alloc(size_t bytes)
+{
+#ifdef _MSC_VER
+    return _aligned_malloc(bytes, 64);
+#else
+    /* The size must be a multiple of the alignment. */
+    return aligned_alloc(64, (bytes + 63) / 64 * 64);
+#endif
+}
+
+void replay_aligned_free(void *data)
+{
+#ifdef _MSC_VER
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+/*
+   Maps `bytes` bytes of the file into memory, extending the file if it is shorter. A file that is
+   not empty must start with the replay memory magic, otherwise it is left untouched. Sets `created`
+   to 1 if the file was new or empty. Returns 0 on success.
+*/
+static int replay_file_map(ReplayFile *file, const char *filename, size_t bytes, int *created)
+{
+    char magic[sizeof(((ReplayHeader *)0)->magic)];
+    file->bytes = bytes;
+#ifdef _WIN32
+    file->file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->file == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER fileSize;
+    DWORD read;
+    if (!GetFileSizeEx(file->file, &fileSize)
+        || (fileSize.QuadPart != 0 && (!ReadFile(file->file, magic, sizeof(magic), &read, NULL)
+            || read != sizeof(magic) || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0)))
+    {
+        CloseHandle(file->file);
+        return -1;
+    }
+    *created = fileSize.QuadPart == 0;
+
+    /* Mapping more than the size of the file extends it. */
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, NULL);
+    if (file->mapping == NULL)
+    {
+        CloseHandle(file->file);
+        return -1;
+    }
+
+    file->base = MapViewOfFile(file->mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (file->base == NULL)
+    {
+        CloseHandle(file->mapping);
+        CloseHandle(file->file);
+        return -1;
+    }
+#else
+    file->fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (file->fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(file->fd, &st) != 0
+        || (st.st_size != 0 && (pread(file->fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)
+            || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0)))
+    {
+        close(file->fd);
+        return -1;
+    }
+    *created = st.st_size == 0;
+
+    /* A new file is extended without writing, so its pages take up no space until they are used. */
+    if ((size_t)st.st_size < bytes && ftruncate(file->fd, (off_t)bytes) != 0)
+    {
+        close(file->fd);
+        return -1;
+    }
+
+    file->base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (file->base == MAP_FAILED)
+    {
+        close(file->fd);
+        return -1;
+    }
+
+    /* The minibatches are read at random, so reading ahead would only waste the page cache. */
+    posix_madvise(file->base + REPLAY_HEADER_BYTES, bytes - REPLAY_HEADER_BYTES, POSIX_MADV_RANDOM);
+#endif
+    file->header = (ReplayHeader *)file->base;
+
+    return 0;
+}
+
+static void replay_file_unmap(ReplayFile *file)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(file->base);
+    CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    munmap(file->base, file->bytes);
+    close(file->fd);
+#endif
+}
+
+/*
+   Called after each record written to a mapped file. Once a chunk of records is complete, it is
+   handed to the operating system for writing, so the dirty pages do not pile up until the process
+   has to wait for them, and the next chunk, which may already be in the file, is read ahead.
+*/
+static void replay_file_advance(Replay *replay)
+{
+    ReplayFile *file = replay->file;
+    size_t next = replay->next;
+    size_t end = next == 0 ? (size_t)replay->capacity : next;
+    if (next != 0 && end - file->chunkStart < file->chunkRecords)
+        return;
+
+    size_t recordBytes = (size_t)replay->stride * sizeof(Scalar);
+#if defined(__linux__)
+    sync_file_range(file->fd, (off_t)(REPLAY_HEADER_BYTES + file->chunkStart * recordBytes),
+        (off_t)((end - file->chunkStart) * recordBytes), SYNC_FILE_RANGE_WRITE);
+#endif
+
+    file->chunkStart = next;
+    size_t chunkEnd = next + file->chunkRecords < (size_t)replay->capacity ? next + file->chunkRecords : (size_t)replay->capacity;
+#ifndef _WIN32
+    /* The advice must start at a page. */
+    size_t start = REPLAY_HEADER_BYTES + next * recordBytes;
+    size_t page = start / REPLAY_PAGE * REPLAY_PAGE;
+    posix_madvise(file->base + page, start - page + (chunkEnd - next) * recordBytes, POSIX_MADV_WILLNEED);
+#else
+    (void)chunkEnd;
+#endif
+}
+
+/* Sets the positions and the sizes of the tree levels, and returns the size of the whole tree. */
+static size_t replay_tree_layout(Replay *replay)
+{
+    size_t total = 0;
+    size_t size = replay->capacity;
+    int level = 0;
+    for (;;)
+    {
+        size = (size + REPLAY_FANOUT - 1) / REPLAY_FANOUT * REPLAY_FANOUT;
+        replay->levelOffset[level] = total;
+        replay->levelSize[level] = size;
+        total += size;
+        level++;
+
+        if (size == REPLAY_FANOUT)
+            break;
+        size /= REPLAY_FANOUT;
+    }
+    replay->levels = level;
+
+    return total;
+}
+
+/* Sets the given node of the given level to the sum of its children. */
+static void replay_tree_sum(Replay *replay, int level, size_t node)
+{
+    const double *children = replay->tree + replay->levelOffset[level - 1] + node * REPLAY_FANOUT;
+    double sum = 0;
+    for (int c = 0; c < REPLAY_FANOUT; c++)
+        sum += children[c];
+    replay->tree[replay->levelOffset[level] + node] = sum;
+}
+
+/* Recomputes the sums on the path from the leaf k to the top of the tree. */
+static void replay_tree_update(Replay *replay, size_t k)
+{
+    for (int level = 1; level < replay->levels; level++)
+    {
+        k /= REPLAY_FANOUT;
+        replay_tree_sum(replay, level, k);
+    }
+}
+
+/* Gives all the stored transitions the largest priority and rebuilds the tree. */
+static void replay_tree_reset(Replay *replay)
+{
+    double *tree = replay->tree;
+    for (size_t i = 0; i < replay->levelSize[0]; i++)
+        tree[i] = i < (size_t)replay->size ? replay->maxPriority : 0;
+
+    for (int level = 1; level < replay->levels; level++)
+    {
+        size_t parents = replay->levelSize[level - 1] / REPLAY_FANOUT;
+        for (size_t node = 0; node < replay->levelSize[level]; node++)
+        {
+            if (node < parents)
+                replay_tree_sum(replay, level, node);
+            else
+                tree[replay->levelOffset[level] + node] = 0;
+        }
+    }
+}
+
+/* Returns the sum of all the priorities. */
+static double replay_tree_total(Replay *replay)
+{
+    const double *top = replay->tree + replay->levelOffset[replay->levels - 1];
+    double total = 0;
+    for (int c = 0; c < REPLAY_FANOUT; c++)
+        total += top[c];
+    return total;
+}
+
+/* Allocates a replay memory without the records. */
+static Replay *replay_allocate(int capacity, int stateSize, int actionSize)
+{
+    Replay *replay = malloc(sizeof(Replay));
+    replay->stateSize = stateSize;
+    replay->actionSize = actionSize;
+    replay->capacity = capacity;
+
+    /* Padding each record to whole cache lines keeps all the records aligned to cache lines. */
+    int recordSize = 2 * stateSize + actionSize + 2;
+    replay->stride = (recordSize + REPLAY_LINE_VALUES - 1) / REPLAY_LINE_VALUES * REPLAY_LINE_VALUES;
+    replay->records = NULL;
+    replay->file = NULL;
+    replay->size = 0;
+    replay->next = 0;
+
+    /* The sampling is uniform until replay_prioritize is called. */
+    replay->alpha = 0;
+    replay->beta = 0;
+    replay->maxPriority = 1;
+    replay->tree = NULL;
+    replay->levels = 0;
+
+    return replay;
+}
+
+Replay *replay_create(int capacity, int stateSize, int actionSize)
+{
+    Replay *replay = replay_allocate(capacity, stateSize, actionSize);
+    replay->records = replay_aligned_alloc((size_t)capacity * replay->stride * sizeof(Scalar));
+
+    return replay;
+}
+
+Replay *replay_create_mapped(const char *filename, int capacity, int stateSize, int actionSize)
+{
+    Replay *replay = replay_allocate(capacity, stateSize, actionSize);
+    ReplayFile *file = malloc(sizeof(ReplayFile));
+    size_t recordBytes = (size_t)replay->stride * sizeof(Scalar);
+
+    int created;
+    if (replay_file_map(file, filename, REPLAY_HEADER_BYTES + (size_t)capacity * recordBytes, &created) != 0)
+    {
+        free(file);
+        free(replay);
+        return NULL;
+    }
+
+    /*
+       An existing file keeps its transitions, unless it was created with other dimensions or its
+       positions are not consistent, which happens if it was truncated or corrupted.
+    */
+    ReplayHeader *header = file->header;
+    if (!created)
+    {
+        if (header->scalarSize != (int32_t)sizeof(Scalar) || header->stateSize != stateSize
+            || header->actionSize != actionSize || header->capacity != capacity || header->stride != replay->stride
+            || header->size < 0 || header->size > capacity || header->next < 0 || header->next >= capacity
+            || (header->size < capacity && header->next != header->size))
+        {
+            replay_file_unmap(file);
+            free(file);
+            free(replay);
+            return NULL;
+        }
+        replay->size = header->size;
+        replay->next = header->next;
+    }
+    else
+    {
+        ReplayHeader init = { REPLAY_MAGIC, sizeof(Scalar), stateSize, actionSize, capacity, replay->stride, 0, 0 };
+        *header = init;
+    }
+
+    replay->records = (Scalar *)(file->base + REPLAY_HEADER_BYTES);
+    replay->file = file;
+    file->chunkRecords = REPLAY_CHUNK_BYTES / recordBytes > 0 ? REPLAY_CHUNK_BYTES / recordBytes : 1;
+    file->chunkStart = replay->next;
+
+    return replay;
+}
+
+void replay_destroy(Replay *replay)
+{
+    if (replay->file != NULL)
+    {
+        replay_file_unmap(replay->file);
+        free(replay->file);
+    }
+    else
+        replay_aligned_free(replay->records);
+
+    if (replay->tree != NULL)
+        replay_aligned_free(replay->tree);
+    free(replay);
+}
+
+void replay_clear(Replay *replay)
+{
+    replay->size = 0;
+    replay->next = 0;
+
+    if (replay->file != NULL)
+    {
+        replay->file->header->size = 0;
+        replay->file->header->next = 0;
+        replay->file->chunkStart = 0;
+    }
+
+    if (replay->tree != NULL)
+    {
+        replay->maxPriority = 1;
+        replay_tree_reset(replay);
+    }
+}
+
+void replay_prioritize(Replay *replay, double alpha, double beta)
+{
+    replay->alpha = alpha;
+    replay->beta = beta;
+
+    if (replay->tree == NULL)
+    {
+        replay->tree = replay_aligned_alloc(replay_tree_layout(replay) * sizeof(double));
+        replay->maxPriority = 1;
+        replay_tree_reset(replay);
+    }
+}
+
+static void replay_copy(Scalar *dst, const Scalar *src, int length)
+{
+    for (int i = 0; i < length; i++)
+        dst[i] = src[i];
+}
+
+/* Returns the record of the transition at position k. */
+static Scalar *replay_record(Replay *replay, size_t k)
+{
+    return replay->records + k * replay->stride;
+}
+
+void replay_add(Replay *replay, const Scalar *state, const Scalar *action, double reward, const Scalar *nextState, int terminal)
+{
+    int stateSize = replay->stateSize;
+    int actionSize = replay->actionSize;
+
+    Scalar *record = replay_record(replay, replay->next);
+    replay_copy(record, state, stateSize);
+    replay_copy(record + stateSize, action, actionSize);
+    record[stateSize + actionSize] = (Scalar)reward;
+    replay_copy(record + stateSize + actionSize + 1, nextState, stateSize);
+    record[2 * stateSize + actionSize + 1] = terminal > 0 ? 1 : 0;
+
+    /* A new transition gets the largest priority, so it is sampled at least once soon. */
+    if (replay->tree != NULL)
+    {
+        replay->tree[replay->next] = replay->maxPriority;
+        replay_tree_update(replay, replay->next);
+    }
+
+    replay->next = (replay->next + 1) % replay->capacity;
+    if (replay->size < replay->capacity)
+        replay->size++;
+
+    /* The header is updated after the record, so a file never counts a transition that was not written. */
+    if (replay->file != NULL)
+    {
+        replay->file->header->size = replay->size;
+        replay->file->header->next = replay->next;
+        replay_file_advance(replay);
+    }
+}
+
+/*
+   Chooses the child of a node in which the prefix sum `value` falls, and subtracts the priorities
+   of the children before it. A value past the last child, due to rounding, falls into the last
+   child with a nonzero priority.
+*/
+static int replay_tree_child(const double *children, double *value)
+{
+    int last = 0;
+    for (int c = 0; c < REPLAY_FANOUT; c++)
+    {
+        if (children[c] > 0)
+        {
+            if (*value < children[c])
+                return c;
+            *value -= children[c];
+            last = c;
+        }
+    }
+
+    *value = children[last];
+    return last;
+}
+
+/*
+   Each group of transitions descends the tree together, one level at a time, so the cache misses
+   of the whole group overlap, and the children needed at the next level are prefetched.
+*/
+static void replay_sample_prioritized(Replay *replay, DeepcRng *rng, int *indices, Scalar *weights, int count)
+{
+    const double *tree = replay->tree;
+    double segment = replay_tree_total(replay) / count;
+
+    for (int start = 0; start < count; start += REPLAY_GROUP)
+    {
+        int n = count - start < REPLAY_GROUP ? count - start : REPLAY_GROUP;
+        double value[REPLAY_GROUP];
+        size_t node[REPLAY_GROUP];
+
+        /* One transition is chosen from each segment of the priorities. */
+        for (int g = 0; g < n; g++)
+        {
+            value[g] = (start + g + deepc_rng_double(rng, 0, 1)) * segment;
+            node[g] = 0;
+        }
+
+        for (int level = replay->levels - 1; level >= 0; level--)
+        {
+            const double *nodes = tree + replay->levelOffset[level];
+            for (int g = 0; g < n; g++)
+            {
+                size_t first = node[g] * REPLAY_FANOUT;
+                node[g] = first + replay_tree_child(nodes + first, &value[g]);
+                if (level > 0)
+                    REPLAY_PREFETCH_LINE(tree + replay->levelOffset[level - 1] + node[g] * REPLAY_FANOUT);
+            }
+        }
+
+        for (int g = 0; g < n; g++)
+            indices[start + g] = (int)node[g];
+    }
+
+    if (weights == NULL)
+        return;
+
+    /*
+       The weight (size * P(i))^-beta, divided by the largest weight of the batch, equals
+       (p(i) / p_min)^-beta, where p_min is the smallest priority in the batch.
+    */
+    double minPriority = tree[indices[0]];
+    for (int i = 1; i < count; i++)
+        if (tree[indices[i]] < minPriority)
+            minPriority = tree[indices[i]];
+
+    for (int i = 0; i < count; i++)
+        weights[i] = (Scalar)pow(tree[indices[i]] / minPriority, -replay->beta);
+}
+
+void replay_sample(Replay *replay, DeepcRng *rng, int *indices, Scalar *weights, int count)
+{
+    if (replay->tree != NULL)
+    {
+        replay_sample_prioritized(replay, rng, indices, weights, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        indices[i] = deepc_rng_int(rng, 0, replay->size - 1);
+
+    if (weights != NULL)
+        for (int i = 0; i < count; i++)
+            weights[i] = 1;
+}
+
+/* The sums are recomputed one level at a time for the whole batch, so the cache misses overlap. */
+void replay_update_priorities(Replay *replay, const int *indices, const Scalar *errors, int count)
+{
+    if (replay->tree == NULL)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        double priority = pow(fabs(errors[i]) + REPLAY_EPSILON, replay->alpha);
+        replay->tree[indices[i]] = priority;
+        if (priority > replay->maxPriority)
+            replay->maxPriority = priority;
+    }
+
+    /* A node shared by several transitions is recomputed more than once, which gives the same sum. */
+    size_t span = 1;
+    for (int level = 1; level < replay->levels; level++)
+    {
+        span *= REPLAY_FANOUT;
+        for (int i = 0; i < count; i++)
+            replay_tree_sum(replay, level, indices[i] / span);
+    }
+}
+
+/* Prefetches all the cache lines of the record at position k. */
+static void replay_prefetch(Replay *replay, size_t k)
+{
+    const Scalar *record = replay_record(replay, k);
+    for (int i = 0; i < replay->stride; i += REPLAY_LINE_VALUES)
+        REPLAY_PREFETCH_LINE(record + i);
+}
+
+/* Copies `length` values to the destination of the i-th transition, if the destination is set. */
+static void replay_store(const ReplayTarget *target, int i, const Scalar *src, int length)
+{
+    if (target->data != NULL)
+        replay_copy(target->data + (size_t)i * target->stride, src, length);
+}
+
+void replay_gather(Replay *replay, const int *indices, int count, const ReplayBatch *batch)
+{
+    int stateSize = replay->stateSize;
+    int actionSize = replay->actionSize;
+
+    for (int i = 0; i < count && i < REPLAY_PREFETCH; i++)
+        replay_prefetch(replay, indices[i]);
+
+    for (int i = 0; i < count; i++)
+    {
+        /* At the start of each block, request all the transitions of the next block. */
+        if (i % REPLAY_PREFETCH == 0)
+            for (int j = i + REPLAY_PREFETCH; j < count && j < i + 2 * REPLAY_PREFETCH; j++)
+                replay_prefetch(replay, indices[j]);
+
+        const Scalar *state = replay_record(replay, indices[i]);
+        const Scalar *action = state + stateSize;
+        const Scalar *reward = action + actionSize;
+        const Scalar *nextState = reward + 1;
+        const Scalar *terminal = nextState + stateSize;
+
+        replay_store(&batch->states[0], i, state, stateSize);
+        replay_store(&batch->states[1], i, state, stateSize);
+        replay_store(&batch->actions, i, action, actionSize);
+        replay_store(&batch->rewards, i, reward, 1);
+        replay_store(&batch->nextStates[0], i, nextState, stateSize);
+        replay_store(&batch->nextStates[1], i, nextState, stateSize);
+        replay_store(&batch->terminals, i, terminal, 1);
+    }
+}
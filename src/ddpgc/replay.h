@@ -0,0 +1,262 @@
+/**
+ * \file   replay.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  The replay memory of the DDPG method
+ *
+ * This unit stores the observed transitions (state, action, reward, next
+ * state, terminal flag) in a ring buffer and gathers random minibatches from
+ * them. Each transition is stored as one record that starts on a cache line
+ * and is padded to a whole number of cache lines, so a random transition
+ * touches as few cache lines (and pages) as possible. A minibatch is gathered
+ * in a single pass that writes every field directly to the buffers where it
+ * is needed, e.g., the inputs of the neural networks.
+ *
+ * Transitions are sampled either uniformly or, after `replay_prioritize` has
+ * been called, in proportion to their priorities (prioritized experience
+ * replay). The priorities are kept in a sum tree, in which every node holds
+ * the sum of its children, so a transition is sampled and its priority updated
+ * in O(log n) time. Each node has `REPLAY_FANOUT` children, which fill exactly
+ * one cache line, so the tree is shallow and each level of a descent costs at
+ * most one cache miss. A batch is sampled one level at a time for a group of
+ * transitions, prefetching the nodes needed at the next level.
+ *
+ * The records are kept either on the heap or in a memory-mapped file (see
+ * `replay_create_mapped`). A mapped memory can be larger than the physical
+ * memory, since only the pages in use are kept in the page cache, and it
+ * survives the end of the process, so training can resume from the stored
+ * transitions. The transitions are written to the file sequentially, and each
+ * completed chunk is handed to the operating system for writing while the
+ * next chunk is read ahead, so the writes never wait for the disk. The mapped
+ * records are marked for random access, which keeps the minibatch reads from
+ * pulling unneeded pages into the page cache.
+ *
+ * With large memories, every gathered transition misses the cache. The gather
+ * therefore works in blocks of `REPLAY_PREFETCH` transitions and prefetches
+ * the whole next block while copying the current one, so that many memory
+ * accesses are in flight at once.
+ */
+
+#include "mlpc.h"
+
+/**
+ * The number of transitions that the gather prefetches at once.
+ */
+#define REPLAY_PREFETCH 16
+
+/**
+ * The number of children of a node in the sum tree of priorities.
+ */
+#define REPLAY_FANOUT 8
+
+/**
+ * The largest number of levels of the sum tree, which suffices for any
+ * capacity of type int.
+ */
+#define REPLAY_LEVELS 12
+
+/**
+ * The smallest priority of a transition, which keeps transitions with zero
+ * error from never being sampled again.
+ */
+#define REPLAY_EPSILON 1e-6
+
+/**
+ * The platform-specific state of a memory-mapped file.
+ */
+typedef struct ReplayFile ReplayFile;
+
+/**
+ * A destination of one field of the gathered transitions. The value(s) of the
+ * i-th transition of the minibatch are written to `data + i * stride`. If
+ * `data` is NULL, the field is not written to this destination.
+ */
+typedef struct ReplayTarget
+{
+    Scalar *data;
+    int stride;
+} ReplayTarget;
+
+/**
+ * The destinations of a minibatch gather. The states and the next states can
+ * each be written to two places at once, e.g., to the input of the actor and
+ * to the state columns of the input of the critic.
+ */
+typedef struct ReplayBatch
+{
+    ReplayTarget states[2];
+    ReplayTarget actions;
+    ReplayTarget rewards;
+    ReplayTarget nextStates[2];
+    ReplayTarget terminals;
+} ReplayBatch;
+
+/**
+ * Definition of a replay memory.
+ */
+typedef struct Replay
+{
+    /**
+     * The dimension of the states.
+     */
+    int stateSize;
+
+    /**
+     * The dimension of the actions.
+     */
+    int actionSize;
+
+    /**
+     * The largest number of transitions stored. When the memory is full, the
+     * oldest transitions are overwritten.
+     */
+    int capacity;
+
+    /**
+     * The number of transitions stored.
+     */
+    int size;
+
+    /**
+     * The position of the next transition to be stored.
+     */
+    int next;
+
+    /**
+     * The number of values between the starts of two consecutive records. It
+     * is the size of one record, rounded up to a whole number of cache lines.
+     */
+    int stride;
+
+    /**
+     * The records of the transitions, aligned to a cache line. The fields of
+     * a record are stored in the order (state, action, reward, next state,
+     * terminal). The position of a record is computed in 64-bit arithmetic,
+     * so the memory can exceed 2^31 values.
+     * Format: (capacity × stride)
+     */
+    Scalar *records;
+
+    /**
+     * The file that holds the records, or NULL if they are on the heap.
+     */
+    ReplayFile *file;
+
+    /**
+     * The priority exponent of the prioritized sampling. A transition with
+     * the error δ is given the priority (|δ| + `REPLAY_EPSILON`)^`alpha`.
+     */
+    double alpha;
+
+    /**
+     * The importance-sampling exponent of the prioritized sampling. The value
+     * 1 fully compensates for the non-uniform sampling.
+     */
+    double beta;
+
+    /**
+     * The priority given to every new transition, which is the largest
+     * priority given so far.
+     */
+    double maxPriority;
+
+    /**
+     * The sum tree of priorities, stored level by level, starting with the
+     * leaves. The tree is NULL if the sampling is uniform.
+     */
+    double *tree;
+
+    /**
+     * The number of levels of the sum tree, and the position and the size of
+     * each level in the `tree` array. The sizes are multiples of
+     * `REPLAY_FANOUT`, and the last level has at most `REPLAY_FANOUT` nodes.
+     */
+    int levels;
+    size_t levelOffset[REPLAY_LEVELS];
+    size_t levelSize[REPLAY_LEVELS];
+} Replay;
+
+/**
+ * Creates a replay memory for `capacity` transitions with states of dimension
+ * `stateSize` and actions of dimension `actionSize`. Every replay memory
+ * created with this function must eventually be destroyed by calling
+ * `replay_destroy`.
+ *
+ * \returns The newly created replay memory.
+ */
+Replay *replay_create(int capacity, int stateSize, int actionSize);
+
+/**
+ * Creates a replay memory whose records are kept in the file `filename`,
+ * which is mapped into memory. If the file does not exist or is empty, a new
+ * replay memory is created in it. If it holds a replay memory with the same
+ * dimensions, its transitions are kept. Any other file is left untouched. The
+ * file takes up one page for the header and `capacity` padded records.
+ *
+ * \returns The newly created replay memory, or NULL if the file could not be
+ * created or mapped, if it is not a replay memory file, or if it holds a
+ * replay memory of other dimensions or with inconsistent positions.
+ */
+Replay *replay_create_mapped(const char *filename, int capacity, int stateSize, int actionSize);
+
+/**
+ * Frees the memory allocated by the given replay memory. A mapped memory is
+ * unmapped, and its file is kept.
+ */
+void replay_destroy(Replay *replay);
+
+/**
+ * Removes all the transitions from the replay memory.
+ */
+void replay_clear(Replay *replay);
+
+/**
+ * Stores a transition to the replay memory. If the memory is full, the oldest
+ * transition is overwritten.
+ */
+void replay_add(Replay *replay, const Scalar *state, const Scalar *action, double reward, const Scalar *nextState, int terminal);
+
+/**
+ * Turns on the prioritized sampling with the priority exponent `alpha` and
+ * the importance-sampling exponent `beta`. The transitions that are already
+ * stored are given the same priority. Calling the function again only changes
+ * the exponents, e.g., to anneal `beta` towards 1.
+ */
+void replay_prioritize(Replay *replay, double alpha, double beta);
+
+/**
+ * Fills the `indices` array with `count` positions of transitions, chosen at
+ * random with the generator `rng`. With prioritized sampling, the range of
+ * priorities is split into `count` equal segments and one transition is
+ * chosen from each, and the importance-sampling weights of the chosen
+ * transitions, normalized to the largest weight of 1, are stored to `weights`.
+ * With uniform sampling, all the weights are 1. The `weights` array can be
+ * NULL.
+ */
+void replay_sample(Replay *replay, DeepcRng *rng, int *indices, Scalar *weights, int count);
+
+/**
+ * Sets the priorities of the `count` transitions at the given `indices` from
+ * their errors, e.g., the temporal difference errors of the critic. The
+ * function does nothing if the sampling is uniform.
+ */
+void replay_update_priorities(Replay *replay, const int *indices, const Scalar *errors, int count);
+
+/**
+ * Gathers the `count` transitions at the given `indices` into the
+ * destinations given by `batch`, in a single pass over the transitions.
+ */
+void replay_gather(Replay *replay, const int *indices, int count, const ReplayBatch *batch);
+
+/**
+ * Allocates `bytes` bytes of memory aligned to a cache line. The memory must be
+ * freed with `replay_aligned_free`.
+ *
+ * \returns The allocated memory.
+ */
+void *replay_aligned_alloc(size_t bytes);
+
+/**
+ * Frees the memory allocated with `replay_aligned_alloc`.
+ */
+void replay_aligned_free(void *data);
@@ -1,40 +1,40 @@
 #include <math.h>
 #include "activation.h"
 
-double activation_linear(double x)
+Scalar activation_linear(Scalar x)
 {
     return x;
 }
 
-double activation_linearDeriv(double y)
+Scalar activation_linearDeriv(Scalar y)
 {
     return 1;
 }
 
-double activation_sigmoid(double x)
+Scalar activation_sigmoid(Scalar x)
 {
     if (x >= 0)
         return 1.0 / (1 + exp(-x));
     else
-        return 1.0 - (1.0 / 1 + exp(x));
+        return exp(x) / (1 + exp(x));
 }
 
-double activation_sigmoidDeriv(double y)
+Scalar activation_sigmoidDeriv(Scalar y)
 {
     return y * (1 - y);
 }
 
-double activation_tanh(double x)
+Scalar activation_tanh(Scalar x)
 {
-    return (exp(x) - exp(-x)) / (exp(x) + exp(-x));
+    return tanh(x);
 }
 
-double activation_tanhDeriv(double y)
+Scalar activation_tanhDeriv(Scalar y)
 {
     return 1 - y*y;
 }
 
-double activation_relu(double x)
+Scalar activation_relu(Scalar x)
 {
     if (x >= 0)
         return x;
@@ -42,7 +42,7 @@ double activation_relu(double x)
         return 0;
 }
 
-double activation_reluDeriv(double y)
+Scalar activation_reluDeriv(Scalar y)
 {
     if (y > 0)
         return 1;
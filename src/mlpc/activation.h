@@ -6,7 +6,7 @@
  *
  * This module defines several activation functions and their derivatives that
  * can be used with neural networks. Activation functions and their derivatives
- * are defined as C functions of type `double f(double)`. They are not visible
+ * are defined as C functions of type `Scalar f(Scalar)`. They are not visible
  * outside the module, but can be obtained as the `ActivationFunction` type of
  * pointers.
  * 
@@ -16,6 +16,8 @@
  * here can be defined to work with activation outputs.
  */
 
+#include "scalar.h"
+
 /**
  * When not using an activation function, provide the ACTIVATION_NONE code.
  * This is equivalent to using the linear activation function f(x) = x.
@@ -37,7 +39,7 @@
 /**
  * The definition of a pointer to an activation function.
  */
-typedef double (*ActivationFunction)(double);
+typedef Scalar (*ActivationFunction)(Scalar);
 
 /**
  * \returns the pointer to the activation function that corresponds to the
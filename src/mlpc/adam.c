@@ -1,6 +1,8 @@
 #include <malloc.h>
 #include <math.h>
 #include "adam.h"
+#include "simd.h"
+#include "threadpool.h"
 
 Adam *adam_create(MLP *mlp)
 {
@@ -11,18 +13,9 @@ Adam *adam_create(MLP *mlp)
     adam->epsilon = 1e-7;
     adam->depth = mlp->depth + 1;
 
-    adam->mw = malloc(adam->depth * sizeof(Matrix));
-    adam->mb = malloc(adam->depth * sizeof(Matrix));
-    adam->vw = malloc(adam->depth * sizeof(Matrix));
-    adam->vb = malloc(adam->depth * sizeof(Matrix));
-
-    for (int i = 0; i < adam->depth; i++)
-    {
-        adam->mw[i] = matrix_clone(mlp->layers[i].weights);
-        adam->mb[i] = matrix_clone(mlp->layers[i].biases);
-        adam->vw[i] = matrix_clone(mlp->layers[i].weights);
-        adam->vb[i] = matrix_clone(mlp->layers[i].biases);
-    }
+    adam->count = mlp->parameterCount;
+    adam->m = matrix_aligned_alloc(adam->count);
+    adam->v = matrix_aligned_alloc(adam->count);
 
     adam_reset(adam);
 
@@ -139,19 +132,8 @@ int adam_write(Adam *adam, FILE *file)
 
 void adam_destroy(Adam *adam)
 {
-    for (int i = 0; i < adam->depth; i++)
-    {
-        matrix_destroy(adam->mw[i]);
-        matrix_destroy(adam->mb[i]);
-        matrix_destroy(adam->vw[i]);
-        matrix_destroy(adam->vb[i]);
-    }
-
-    free(adam->mw);
-    free(adam->mb);
-    free(adam->vw);
-    free(adam->vb);
-
+    matrix_aligned_free(adam->m);
+    matrix_aligned_free(adam->v);
     free(adam);
 }
 
@@ -169,63 +151,63 @@ void adam_reset(Adam *adam)
     adam->beta1t = adam->beta1;
     adam->beta2t = adam->beta2;
 
-    for (int i = 0; i < adam->depth; i++)
-    {
-        matrix_clear(adam->mw[i]);
-        matrix_clear(adam->mb[i]);
-        matrix_clear(adam->vw[i]);
-        matrix_clear(adam->vb[i]);
-    }   
+    for (int i = 0; i < adam->count; i++)
+        adam->m[i] = adam->v[i] = 0;
+}
+
+/* The arguments of an Adam step that is split across the thread pool. */
+typedef struct AdamTask
+{
+    Scalar *w;
+    const Scalar *g;
+    Scalar *m;
+    Scalar *v;
+    int count;
+    int chunk;
+    AdamCoefficients coefficients;
+} AdamTask;
+
+/* Updates the parameters [index * chunk, (index + 1) * chunk). */
+static void adam_task(void *arg, int index, int count)
+{
+    AdamTask *t = arg;
+    int i = index * t->chunk;
+    int n = t->count - i < t->chunk ? t->count - i : t->chunk;
+
+    simd.adam(t->w + i, t->g + i, t->m + i, t->v + i, n, &t->coefficients);
 }
 
 void adam_optimize(MLP *mlp, Adam *adam)
 {
     adam->t++;
 
-    for (int i = 0; i < adam->depth; i++)
+    /* The bias corrections are the same for every parameter, so they are computed once per step. */
+    AdamTask task;
+    task.w = mlp->parameters;
+    task.g = mlp->gradients;
+    task.m = adam->m;
+    task.v = adam->v;
+    task.count = adam->count;
+    task.coefficients.beta1 = (Scalar)adam->beta1;
+    task.coefficients.beta2 = (Scalar)adam->beta2;
+    task.coefficients.stepSize = (Scalar)(adam->alpha / (1 - adam->beta1t));
+    task.coefficients.correction = (Scalar)(1 / sqrt(1 - adam->beta2t));
+    task.coefficients.epsilon = (Scalar)adam->epsilon;
+
+    /* All the weights and biases are updated in a single pass, split into cache line aligned chunks for large models. */
+    int threads = threadpool_size();
+    if (threads == 1 || task.count < ADAM_PARALLEL)
     {
-        Matrix *w = &mlp->layers[i].weights;
-        Matrix *b = &mlp->layers[i].biases;
-        Matrix *gw = &mlp->layers[i].gradWeights;
-        Matrix *gb = &mlp->layers[i].gradBiases;
-        Matrix *mw = &adam->mw[i];
-        Matrix *mb = &adam->mb[i];
-        Matrix *vw = &adam->vw[i];
-        Matrix *vb = &adam->vb[i];
-
-        double mw1, mb1, vw1, vb1;
-
-        for (int row = 0; row < w->rows; row++)
-        {
-            for (int col = 0; col < w->columns; col++)
-            {
-                int idx = row * w->columns + col;
-
-                mw->data[idx] = adam->beta1 * mw->data[idx] + (1 - adam->beta1) * gw->data[idx];
-                vw->data[idx] = adam->beta2 * vw->data[idx] + (1 - adam->beta2) * gw->data[idx] * gw->data[idx];
-                mw1 = mw->data[idx] / (1 - adam->beta1t);
-                vw1 = vw->data[idx] / (1 - adam->beta2t);
-
-                w->data[idx] -= adam->alpha * (mw1 / (sqrt(vw1) + adam->epsilon));
-            }
-        }
-
-        for (int row = 0; row < b->rows; row++)
-        {
-            for (int col = 0; col < b->columns; col++)
-            {
-                int idx = row * b->columns + col;
-
-                mb->data[idx] = adam->beta1 * mb->data[idx] + (1 - adam->beta1) * gb->data[idx];
-                vb->data[idx] = adam->beta2 * vb->data[idx] + (1 - adam->beta2) * gb->data[idx] * gb->data[idx];
-                mb1 = mb->data[idx] / (1 - adam->beta1t);
-                vb1 = vb->data[idx] / (1 - adam->beta2t);
-
-                b->data[idx] -= adam->alpha * (mb1 / (sqrt(vb1) + adam->epsilon));
-            }
-        }
+        task.chunk = task.count;
+        adam_task(&task, 0, 1);
+    }
+    else
+    {
+        int align = MATRIX_ALIGNMENT / (int)sizeof(Scalar);
+        task.chunk = ((task.count + threads - 1) / threads + align - 1) / align * align;
+        threadpool_run(adam_task, &task, (task.count + task.chunk - 1) / task.chunk);
     }
 
     adam->beta1t *= adam->beta1;
     adam->beta2t *= adam->beta2;
-}
\ No newline at end of file
+}
@@ -13,6 +13,12 @@
 #include <stdio.h>
 #include "mlp.h"
 
+/**
+ * Models with fewer parameters than this value are optimized on the calling
+ * thread, even when the thread pool is running.
+ */
+#define ADAM_PARALLEL 65536
+
 /**
  * The Adam structure that is bound to a specific MLP and used only with it.
  */
@@ -60,28 +66,22 @@ typedef struct Adam
     int depth;
 
     /**
-     * The moment vector for weights at time t. An array of matrices, one
-     * matrix for each layer.
-     */
-    Matrix *mw;
-    
-    /**
-     * The moment vector for biases at time t. An array of matrices, one
-     * matrix for each layer.
+     * The number of parameters of the MLP, which is also the length of the
+     * moment arrays.
      */
-    Matrix *mb;
+    int count;
 
     /**
-     * The infinity norm for weights at time t. An array of matrices, one
-     * matrix for each layer.
+     * The first moment of every weight and bias at time t, in the same layout
+     * as the `parameters` array of the MLP.
      */
-    Matrix *vw;
+    Scalar *m;
 
     /**
-     * The infinity norm for biases at time t. An array of matrices, one
-     * matrix for each layer.
+     * The second moment of every weight and bias at time t, in the same layout
+     * as the `parameters` array of the MLP.
      */
-    Matrix *vb;
+    Scalar *v;
 } Adam;
 
 /**
@@ -116,6 +116,7 @@ void adam_reset(Adam *adam);
 
 /**
  * Performs one optimization step on the given `mlp` with the given `adam`
- * optimizer.
+ * optimizer. All the parameters are updated in a single vectorized pass, which
+ * is split across the thread pool for large models.
  */
 void adam_optimize(MLP *mlp, Adam *adam);
\ No newline at end of file
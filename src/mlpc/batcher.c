@@ -0,0 +1,215 @@
+#include <malloc.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "batcher.h"
+
+/* Returns the current time in nanoseconds. */
+static double batcher_now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Converts a time in nanoseconds to the form used by cnd_timedwait. */
+static struct timespec batcher_timespec(double time)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(time / 1e9);
+    ts.tv_nsec = (long)(time - ts.tv_sec * 1e9);
+    return ts;
+}
+
+/*
+   Waits for the next batch and moves its requests out of the queue. Returns the
+   number of requests in the batch, or 0 if the batcher is stopping and the queue
+   is empty. Called with the mutex locked.
+*/
+static int batcher_collect(Batcher *batcher)
+{
+    while (batcher->count == 0 && !batcher->stopping)
+        cnd_wait(&batcher->notEmpty, &batcher->mutex);
+
+    if (batcher->count == 0)
+        return 0;
+
+    /* Wait for more requests until the batch is full or the oldest request is due. */
+    struct timespec deadline = batcher_timespec(batcher->times[batcher->head] + batcher->maxDelay * 1e3);
+    while (batcher->count < batcher->batchSize && !batcher->stopping)
+        if (cnd_timedwait(&batcher->notEmpty, &batcher->mutex, &deadline) == thrd_timedout)
+            break;
+
+    int rows = batcher->count < batcher->batchSize ? batcher->count : batcher->batchSize;
+    int inputSize = batcher->inputs.columns;
+    for (int i = 0; i < rows; i++)
+    {
+        int index = (batcher->head + i) % batcher->capacity;
+        for (int j = 0; j < inputSize; j++)
+            MATRIX(batcher->batch, i, j) = MATRIX(batcher->inputs, index, j);
+        batcher->batchRequests[i] = batcher->requests[index];
+    }
+
+    batcher->head = (batcher->head + rows) % batcher->capacity;
+    batcher->count -= rows;
+    batcher->stats.queueDepth = batcher->count;
+    cnd_broadcast(&batcher->notFull);
+
+    return rows;
+}
+
+static int batcher_dispatch(void *arg)
+{
+    Batcher *batcher = arg;
+
+    mtx_lock(&batcher->mutex);
+    for (;;)
+    {
+        int rows = batcher_collect(batcher);
+        if (rows == 0)
+            break;
+        mtx_unlock(&batcher->mutex);
+
+        /* The requests are evaluated and answered without holding the lock. */
+        Matrix output = mlp_context_feedforward(batcher->mlp, batcher->context, matrix_rows(batcher->batch, 0, rows));
+        for (int i = 0; i < rows; i++)
+            batcher->batchRequests[i].callback(batcher->batchRequests[i].arg, &MATRIX(output, i, 0));
+
+        mtx_lock(&batcher->mutex);
+        batcher->stats.requests += rows;
+        batcher->stats.batches++;
+        cnd_broadcast(&batcher->completed);
+    }
+    mtx_unlock(&batcher->mutex);
+
+    return 0;
+}
+
+Batcher *batcher_create(MLP *mlp, int batchSize, int maxDelay, int capacity)
+{
+    if (capacity <= 0)
+        capacity = 4 * batchSize;
+    if (capacity < batchSize)
+        capacity = batchSize;
+
+    int inputSize = mlp->layers[0].weights.columns;
+
+    Batcher *batcher = malloc(sizeof(Batcher));
+    batcher->mlp = mlp;
+    batcher->context = mlp_context_create(mlp, batchSize);
+    batcher->batchSize = batchSize;
+    batcher->maxDelay = maxDelay;
+    batcher->capacity = capacity;
+    batcher->requests = malloc(capacity * sizeof(BatcherRequest));
+    batcher->head = 0;
+    batcher->count = 0;
+    batcher->inputs = matrix_create(capacity, inputSize);
+    batcher->times = malloc(capacity * sizeof(double));
+    batcher->batch = matrix_create(batchSize, inputSize);
+    batcher->batchRequests = malloc(batchSize * sizeof(BatcherRequest));
+    batcher->stats = (BatcherStats){ 0, 0, 0, 0, 0 };
+    batcher->stopping = 0;
+
+    mtx_init(&batcher->mutex, mtx_plain);
+    cnd_init(&batcher->notEmpty);
+    cnd_init(&batcher->notFull);
+    cnd_init(&batcher->completed);
+
+    if (thrd_create(&batcher->dispatcher, batcher_dispatch, batcher) != thrd_success)
+    {
+        batcher->stopping = 1;
+        batcher_destroy(batcher);
+        return NULL;
+    }
+
+    return batcher;
+}
+
+void batcher_destroy(Batcher *batcher)
+{
+    if (!batcher->stopping)
+    {
+        mtx_lock(&batcher->mutex);
+        batcher->stopping = 1;
+        cnd_broadcast(&batcher->notEmpty);
+        mtx_unlock(&batcher->mutex);
+
+        thrd_join(batcher->dispatcher, NULL);
+    }
+
+    cnd_destroy(&batcher->completed);
+    cnd_destroy(&batcher->notFull);
+    cnd_destroy(&batcher->notEmpty);
+    mtx_destroy(&batcher->mutex);
+
+    mlp_context_destroy(batcher->context);
+    free(batcher->requests);
+    matrix_destroy(batcher->inputs);
+    free(batcher->times);
+    matrix_destroy(batcher->batch);
+    free(batcher->batchRequests);
+    free(batcher);
+}
+
+void batcher_submit(Batcher *batcher, const Scalar *input, BatcherCallback callback, void *arg)
+{
+    mtx_lock(&batcher->mutex);
+    while (batcher->count == batcher->capacity)
+        cnd_wait(&batcher->notFull, &batcher->mutex);
+
+    int index = (batcher->head + batcher->count) % batcher->capacity;
+    for (int j = 0; j < batcher->inputs.columns; j++)
+        MATRIX(batcher->inputs, index, j) = input[j];
+    batcher->requests[index] = (BatcherRequest){ callback, arg };
+    batcher->times[index] = batcher_now();
+    batcher->count++;
+
+    batcher->stats.queueDepth = batcher->count;
+    if (batcher->count > batcher->stats.maxQueueDepth)
+        batcher->stats.maxQueueDepth = batcher->count;
+
+    /* The dispatcher only needs to wake up for the first request and for a full batch. */
+    if (batcher->count == 1 || batcher->count == batcher->batchSize)
+        cnd_signal(&batcher->notEmpty);
+    mtx_unlock(&batcher->mutex);
+}
+
+/* The state of a blocking request. */
+typedef struct BatcherResult
+{
+    Scalar *output;
+    int outputSize;
+    atomic_int done;
+} BatcherResult;
+
+static void batcher_store(void *arg, const Scalar *output)
+{
+    BatcherResult *result = arg;
+    for (int i = 0; i < result->outputSize; i++)
+        result->output[i] = output[i];
+    atomic_store(&result->done, 1);
+}
+
+void batcher_evaluate(Batcher *batcher, const Scalar *input, Scalar *output)
+{
+    BatcherResult result;
+    result.output = output;
+    result.outputSize = batcher->mlp->layers[batcher->mlp->depth].weights.rows;
+    atomic_init(&result.done, 0);
+
+    batcher_submit(batcher, input, batcher_store, &result);
+
+    /* The dispatcher signals the completion of each batch while holding the mutex. */
+    mtx_lock(&batcher->mutex);
+    while (!atomic_load(&result.done))
+        cnd_wait(&batcher->completed, &batcher->mutex);
+    mtx_unlock(&batcher->mutex);
+}
+
+void batcher_get_stats(Batcher *batcher, BatcherStats *stats)
+{
+    mtx_lock(&batcher->mutex);
+    *stats = batcher->stats;
+    if (stats->batches > 0)
+        stats->batchFill = (double)stats->requests / stats->batches / batcher->batchSize;
+    mtx_unlock(&batcher->mutex);
+}
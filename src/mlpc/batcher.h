@@ -0,0 +1,200 @@
+/**
+ * \file   batcher.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Dynamic batching of single-sample inference requests
+ *
+ * When many threads evaluate a MLP on one sample each, every call runs a whole
+ * feedforward pass for a single row, and the blocked GEMM never gets a batch
+ * to work on. A batcher collects such requests from any number of threads and
+ * evaluates them together.
+ *
+ * The requests are copied into a queue. A dispatcher thread waits until the
+ * queue holds `batchSize` requests, or until the oldest request has waited
+ * for `maxDelay` microseconds, and then evaluates all the collected requests
+ * with one call to `mlp_context_feedforward`. The result of each request is
+ * either passed to a callback, which is called on the dispatcher thread, or
+ * returned to a caller that blocks until it is ready.
+ *
+ * The batcher only reads the MLP, through its own feedforward context (see
+ * `MLPContext`), so the MLP can be shared with other batchers and contexts.
+ * It must not be trained or changed while the batcher is running.
+ *
+ * The batcher is built on the C11 threads library.
+ */
+
+#include <threads.h>
+#include "mlp.h"
+
+/**
+ * Receives the result of a request. The `output` array holds the output
+ * values of the MLP for the submitted input and is only valid during the
+ * call. The callback is called on the dispatcher thread, so it should return
+ * quickly.
+ */
+typedef void (*BatcherCallback)(void *arg, const Scalar *output);
+
+/**
+ * The metrics of a batcher, collected since its creation.
+ */
+typedef struct BatcherStats
+{
+    /**
+     * The number of requests that have been evaluated.
+     */
+    long long requests;
+
+    /**
+     * The number of batches that have been evaluated.
+     */
+    long long batches;
+
+    /**
+     * The average number of requests per batch, divided by the batch size.
+     * A value of 1 means that every batch was full.
+     */
+    double batchFill;
+
+    /**
+     * The number of requests currently waiting in the queue.
+     */
+    int queueDepth;
+
+    /**
+     * The largest number of requests that were waiting in the queue at once.
+     */
+    int maxQueueDepth;
+} BatcherStats;
+
+/**
+ * A request waiting in the queue.
+ */
+typedef struct BatcherRequest
+{
+    BatcherCallback callback;
+    void *arg;
+} BatcherRequest;
+
+/**
+ * Definition of a batcher.
+ */
+typedef struct Batcher
+{
+    /**
+     * The evaluated MLP.
+     */
+    MLP *mlp;
+
+    /**
+     * The feedforward workspace used by the dispatcher thread.
+     */
+    MLPContext *context;
+
+    /**
+     * The largest number of requests evaluated at once.
+     */
+    int batchSize;
+
+    /**
+     * The longest time in microseconds that a request waits for the batch to
+     * fill up.
+     */
+    int maxDelay;
+
+    /**
+     * The number of requests that the queue can hold. When the queue is full,
+     * the submitting threads wait.
+     */
+    int capacity;
+
+    /**
+     * The queue of requests, a ring buffer of `capacity` elements starting at
+     * `head`, with `count` elements in use.
+     */
+    BatcherRequest *requests;
+    int head;
+    int count;
+
+    /**
+     * The inputs of the queued requests, stored at the same positions as the
+     * requests. Format: (capacity × input size)
+     */
+    Matrix inputs;
+
+    /**
+     * The submission time of each queued request, in nanoseconds.
+     */
+    double *times;
+
+    /**
+     * The batch of inputs given to the MLP. Format: (batch size × input size)
+     */
+    Matrix batch;
+
+    /**
+     * The requests of the batch being evaluated.
+     */
+    BatcherRequest *batchRequests;
+
+    /**
+     * The metrics, see `BatcherStats`.
+     */
+    BatcherStats stats;
+
+    /**
+     * Guards the state above and signals the changes of the queue.
+     */
+    mtx_t mutex;
+    cnd_t notEmpty;
+    cnd_t notFull;
+    cnd_t completed;
+
+    /**
+     * Set when the batcher is being destroyed.
+     */
+    int stopping;
+
+    /**
+     * The dispatcher thread.
+     */
+    thrd_t dispatcher;
+} Batcher;
+
+/**
+ * Creates a batcher for the given `mlp` and starts its dispatcher thread. Up
+ * to `batchSize` requests are evaluated at once, and no request waits longer
+ * than `maxDelay` microseconds for the batch to fill up. The queue holds up to
+ * `capacity` requests; a value of 0 or less uses four times the batch size.
+ * Every batcher created with this function must eventually be destroyed by
+ * calling `batcher_destroy`.
+ *
+ * \returns The newly created batcher, or NULL if the dispatcher thread could
+ * not be started.
+ */
+Batcher *batcher_create(MLP *mlp, int batchSize, int maxDelay, int capacity);
+
+/**
+ * Evaluates all the queued requests, stops the dispatcher thread and frees the
+ * memory allocated by the batcher. No requests may be submitted during or
+ * after this call.
+ */
+void batcher_destroy(Batcher *batcher);
+
+/**
+ * Submits a single `input` sample (an array of input size values) and returns
+ * immediately, unless the queue is full. The input is copied, so the array can
+ * be reused at once. When the sample has been evaluated, the `callback` is
+ * called with the given `arg` and the output values.
+ */
+void batcher_submit(Batcher *batcher, const Scalar *input, BatcherCallback callback, void *arg);
+
+/**
+ * Submits a single `input` sample and waits until it has been evaluated. The
+ * output values are stored to the `output` array (of output size values).
+ */
+void batcher_evaluate(Batcher *batcher, const Scalar *input, Scalar *output);
+
+/**
+ * Stores the current metrics of the batcher to `stats`.
+ */
+void batcher_get_stats(Batcher *batcher, BatcherStats *stats);
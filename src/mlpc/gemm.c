@@ -0,0 +1,334 @@
+#include <malloc.h>
+#include <threads.h>
+#include "gemm.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+/* Per-thread packing buffers, allocated on first use. */
+typedef struct GemmScratch
+{
+    Scalar *packedA;
+    Scalar *packedB;
+} GemmScratch;
+
+static THREAD_LOCAL GemmScratch *scratch = NULL;
+
+/* The block is also registered under a key, whose destructor frees it when the thread exits. */
+static tss_t scratchKey;
+static once_flag scratchOnce = ONCE_FLAG_INIT;
+
+static void gemm_scratch_free(void *arg)
+{
+    GemmScratch *s = arg;
+    free(s->packedA);
+    free(s->packedB);
+    free(s);
+}
+
+static void gemm_scratch_key_create()
+{
+    tss_create(&scratchKey, gemm_scratch_free);
+}
+
+static GemmScratch *gemm_scratch()
+{
+    if (scratch == NULL)
+    {
+        call_once(&scratchOnce, gemm_scratch_key_create);
+        scratch = malloc(sizeof(GemmScratch));
+        scratch->packedA = malloc(GEMM_MC * GEMM_KC * sizeof(Scalar));
+        scratch->packedB = malloc(GEMM_KC * GEMM_NC * sizeof(Scalar));
+        tss_set(scratchKey, scratch);
+    }
+    return scratch;
+}
+
+/* Computes small products directly, with the inner loop running along the rows of B and C. */
+static void gemm_small(
+    int m, int n, int k,
+    const Scalar *a, int rsa, int csa,
+    const Scalar *b, int rsb, int csb,
+    Scalar *c, int rsc, int csc,
+    const GemmEpilogue *epilogue)
+{
+    for (int i = 0; i < m; i++)
+    {
+        Scalar *ci = c + i * rsc;
+        for (int j = 0; j < n; j++)
+            ci[j * csc] = 0;
+
+        for (int p = 0; p < k; p++)
+        {
+            Scalar aip = a[i * rsa + p * csa];
+            const Scalar *bp = b + p * rsb;
+            for (int j = 0; j < n; j++)
+                ci[j * csc] += aip * bp[j * csb];
+        }
+    }
+
+    if (epilogue != NULL)
+        simd.gemmEpilogue(c, rsc, csc, m, n, epilogue);
+}
+
+/*
+   Packs a (mc × kc) block of A into row panels of height GEMM_MR. Within a panel
+   the GEMM_MR values of each column are stored consecutively. The last panel is
+   padded with zeros.
+*/
+static void gemm_pack_a(int mc, int kc, const Scalar *a, int rsa, int csa, Scalar *dst)
+{
+    for (int i = 0; i < mc; i += GEMM_MR)
+    {
+        int mr = mc - i < GEMM_MR ? mc - i : GEMM_MR;
+        for (int p = 0; p < kc; p++)
+        {
+            for (int ii = 0; ii < mr; ii++)
+                *(dst++) = a[(i + ii) * rsa + p * csa];
+            for (int ii = mr; ii < GEMM_MR; ii++)
+                *(dst++) = 0;
+        }
+    }
+}
+
+/*
+   Packs a (kc × nc) block of B into column panels of width GEMM_NR. Within a
+   panel the GEMM_NR values of each row are stored consecutively. The last panel
+   is padded with zeros.
+*/
+static void gemm_pack_b(int kc, int nc, const Scalar *b, int rsb, int csb, Scalar *dst)
+{
+    for (int j = 0; j < nc; j += GEMM_NR)
+    {
+        int nr = nc - j < GEMM_NR ? nc - j : GEMM_NR;
+        for (int p = 0; p < kc; p++)
+        {
+            const Scalar *bp = b + p * rsb + j * csb;
+            for (int jj = 0; jj < nr; jj++)
+                *(dst++) = bp[jj * csb];
+            for (int jj = nr; jj < GEMM_NR; jj++)
+                *(dst++) = 0;
+        }
+    }
+}
+
+/*
+   Multiplies the packed (mc × kc) block of A with the packed (kc × nc) block of B.
+   The epilogue, if given, has its bias pointing at the first element of the block
+   and is passed to each micro-kernel with the bias moved to the tile.
+*/
+static void gemm_macro_kernel(
+    int mc, int nc, int kc,
+    const Scalar *a, const Scalar *b,
+    Scalar *c, int rsc, int csc, int accumulate,
+    const GemmEpilogue *epilogue)
+{
+    GemmEpilogue tileEpilogue;
+    if (epilogue != NULL)
+        tileEpilogue = *epilogue;
+
+    for (int j = 0; j < nc; j += GEMM_NR)
+    {
+        int nr = nc - j < GEMM_NR ? nc - j : GEMM_NR;
+        for (int i = 0; i < mc; i += GEMM_MR)
+        {
+            int mr = mc - i < GEMM_MR ? mc - i : GEMM_MR;
+            if (epilogue != NULL && epilogue->bias != NULL)
+                tileEpilogue.bias = epilogue->bias + i * epilogue->rsBias + j * epilogue->csBias;
+            simd.gemmKernel(
+                kc, a + i * kc, b + j * kc, c + i * rsc + j * csc, rsc, csc, mr, nr, accumulate,
+                epilogue != NULL ? &tileEpilogue : NULL);
+        }
+    }
+}
+
+/* Computes the product on the calling thread. */
+static void gemm_serial(
+    int m, int n, int k,
+    const Scalar *a, int rsa, int csa,
+    const Scalar *b, int rsb, int csb,
+    Scalar *c, int rsc, int csc,
+    const GemmEpilogue *epilogue)
+{
+    if (k <= 0 || (double)m * n * k < GEMM_SMALL)
+    {
+        gemm_small(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, epilogue);
+        return;
+    }
+
+    /* The epilogue is applied while computing the last block of the K dimension. */
+    GemmEpilogue blockEpilogue;
+    if (epilogue != NULL)
+        blockEpilogue = *epilogue;
+
+    GemmScratch *buffers = gemm_scratch();
+    Scalar *packedA = buffers->packedA;
+    Scalar *packedB = buffers->packedB;
+
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            gemm_pack_b(kc, nc, b + pc * rsb + jc * csb, rsb, csb, packedB);
+
+            for (int ic = 0; ic < m; ic += GEMM_MC)
+            {
+                int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                gemm_pack_a(mc, kc, a + ic * rsa + pc * csa, rsa, csa, packedA);
+                const GemmEpilogue *last = NULL;
+                if (epilogue != NULL && pc + kc == k)
+                {
+                    if (epilogue->bias != NULL)
+                        blockEpilogue.bias = epilogue->bias + ic * epilogue->rsBias + jc * epilogue->csBias;
+                    last = &blockEpilogue;
+                }
+                gemm_macro_kernel(mc, nc, kc, packedA, packedB, c + ic * rsc + jc * csc, rsc, csc, pc > 0, last);
+            }
+        }
+    }
+}
+
+/* The arguments of a product that is split across the thread pool. */
+typedef struct GemmTask
+{
+    int m, n, k;
+    const Scalar *a;
+    int rsa, csa;
+    const Scalar *b;
+    int rsb, csb;
+    Scalar *c;
+    int rsc, csc;
+    const GemmEpilogue *epilogue;
+
+    /* The size of the part computed by each task along the split dimension. */
+    int chunk;
+
+    /* The private results of the tasks 1, 2, ... when the K dimension is split. */
+    Scalar *partials;
+} GemmTask;
+
+/* Computes the rows [index * chunk, (index + 1) * chunk) of C. */
+static void gemm_task_rows(void *arg, int index, int count)
+{
+    GemmTask *t = arg;
+    int i = index * t->chunk;
+    int rows = t->m - i < t->chunk ? t->m - i : t->chunk;
+
+    GemmEpilogue epilogue;
+    if (t->epilogue != NULL)
+    {
+        epilogue = *t->epilogue;
+        if (epilogue.bias != NULL)
+            epilogue.bias += i * epilogue.rsBias;
+    }
+
+    gemm_serial(rows, t->n, t->k,
+        t->a + i * t->rsa, t->rsa, t->csa,
+        t->b, t->rsb, t->csb,
+        t->c + i * t->rsc, t->rsc, t->csc,
+        t->epilogue != NULL ? &epilogue : NULL);
+}
+
+/* Computes the columns [index * chunk, (index + 1) * chunk) of C. */
+static void gemm_task_columns(void *arg, int index, int count)
+{
+    GemmTask *t = arg;
+    int j = index * t->chunk;
+    int columns = t->n - j < t->chunk ? t->n - j : t->chunk;
+
+    GemmEpilogue epilogue;
+    if (t->epilogue != NULL)
+    {
+        epilogue = *t->epilogue;
+        if (epilogue.bias != NULL)
+            epilogue.bias += j * epilogue.csBias;
+    }
+
+    gemm_serial(t->m, columns, t->k,
+        t->a, t->rsa, t->csa,
+        t->b + j * t->csb, t->rsb, t->csb,
+        t->c + j * t->csc, t->rsc, t->csc,
+        t->epilogue != NULL ? &epilogue : NULL);
+}
+
+/*
+   Computes the product over the common dimension [index * chunk, (index + 1) * chunk).
+   The first task writes into C, the others into their private (m × n) buffers.
+*/
+static void gemm_task_depth(void *arg, int index, int count)
+{
+    GemmTask *t = arg;
+    int p = index * t->chunk;
+    int depth = t->k - p < t->chunk ? t->k - p : t->chunk;
+
+    if (index == 0)
+        gemm_serial(t->m, t->n, depth, t->a, t->rsa, t->csa, t->b, t->rsb, t->csb, t->c, t->rsc, t->csc, NULL);
+    else
+        gemm_serial(t->m, t->n, depth,
+            t->a + p * t->csa, t->rsa, t->csa,
+            t->b + p * t->rsb, t->rsb, t->csb,
+            t->partials + (index - 1) * t->m * t->n, t->n, 1, NULL);
+}
+
+void gemm(
+    int m, int n, int k,
+    const Scalar *a, int rsa, int csa,
+    const Scalar *b, int rsb, int csb,
+    Scalar *c, int rsc, int csc,
+    const GemmEpilogue *epilogue)
+{
+    if (m <= 0 || n <= 0)
+        return;
+
+    int threads = threadpool_size();
+    if (threads == 1 || k <= 0 || (double)m * n * k < GEMM_PARALLEL)
+    {
+        gemm_serial(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, epilogue);
+        return;
+    }
+
+    GemmTask task = { m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, epilogue, 0, NULL };
+
+    if (m >= threads * GEMM_MR && m >= n)
+    {
+        /* Split the rows of C. The parts are multiples of the register tile height. */
+        task.chunk = ((m + threads - 1) / threads + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+        threadpool_run(gemm_task_rows, &task, (m + task.chunk - 1) / task.chunk);
+    }
+    else if (n >= threads * GEMM_NR)
+    {
+        /* Split the columns of C. The parts are multiples of the register tile width. */
+        task.chunk = ((n + threads - 1) / threads + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+        threadpool_run(gemm_task_columns, &task, (n + task.chunk - 1) / task.chunk);
+    }
+    else if (k >= threads * GEMM_KC)
+    {
+        /* C is too small to be split, so the common dimension is split instead
+           and the partial products are summed at the end. */
+        task.chunk = ((k + threads - 1) / threads + GEMM_KC - 1) / GEMM_KC * GEMM_KC;
+        int count = (k + task.chunk - 1) / task.chunk;
+        task.partials = malloc((size_t)(count - 1) * m * n * sizeof(Scalar));
+        threadpool_run(gemm_task_depth, &task, count);
+
+        for (int t = 1; t < count; t++)
+        {
+            const Scalar *partial = task.partials + (size_t)(t - 1) * m * n;
+            for (int i = 0; i < m; i++)
+                for (int j = 0; j < n; j++)
+                    c[i * rsc + j * csc] += partial[i * n + j];
+        }
+        free(task.partials);
+
+        if (epilogue != NULL)
+            simd.gemmEpilogue(c, rsc, csc, m, n, epilogue);
+    }
+    else
+        gemm_serial(m, n, k, a, rsa, csa, b, rsb, csb, c, rsc, csc, epilogue);
+}
@@ -0,0 +1,121 @@
+/**
+ * \file   gemm.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  General matrix multiplication engine
+ *
+ * This unit implements the matrix product C = A x B, which is used by the
+ * `matrix_dot` family of functions and is where a MLP spends most of its time.
+ * The implementation follows the well-known blocked GEMM scheme:
+ *
+ *   1. The columns of B are split into blocks of width `GEMM_NC` and the
+ *      common dimension into blocks of depth `GEMM_KC`. A `GEMM_KC × GEMM_NC`
+ *      block of B is packed into a contiguous buffer of `GEMM_NR` wide column
+ *      panels, which stays in the L3 cache.
+ *   2. The rows of A are split into blocks of height `GEMM_MC`. A
+ *      `GEMM_MC × GEMM_KC` block of A is packed into `GEMM_MR` high row
+ *      panels, which stays in the L2 cache.
+ *   3. A micro-kernel multiplies one A panel with one B panel and accumulates
+ *      a `GEMM_MR × GEMM_NR` tile of C in registers. The micro-kernel for the
+ *      running CPU is selected by the SIMD unit (see simd.h).
+ *
+ * Every matrix is described by a pointer and two strides - the distance
+ * between two consecutive rows and two consecutive columns. A transposed
+ * matrix is therefore obtained simply by swapping its strides, without
+ * touching the data.
+ *
+ * An optional epilogue adds a bias to C and applies an activation function to
+ * it. It is applied to each tile of C right after the micro-kernel has
+ * computed its final value, while the tile is still in registers, which saves
+ * two additional passes over C.
+ *
+ * The packing buffers are allocated once per thread on first use and reused
+ * by all subsequent calls. They are freed by a thread-specific storage
+ * destructor when a thread started with the C11 threads library exits.
+ *
+ * When the thread pool is running (see threadpool.h), large products are split
+ * across the threads. Normally the rows or the columns of C are divided, so
+ * that each thread computes its own part of C. When C is too small to be
+ * divided but the common dimension is long, each thread multiplies a slice of
+ * the common dimension and the partial products are summed.
+ */
+
+#include "scalar.h"
+
+/** The height of the register tile computed by the micro-kernel. */
+#define GEMM_MR 6
+
+/**
+ * The width of the register tile computed by the micro-kernel. It spans the
+ * same number of vector registers for both element types.
+ */
+#ifdef MLPC_FLOAT
+#define GEMM_NR 16
+#else
+#define GEMM_NR 8
+#endif
+
+/** The height of the packed A block (a multiple of `GEMM_MR`). */
+#define GEMM_MC 96
+
+/** The depth of the packed A and B blocks. */
+#define GEMM_KC 256
+
+/** The width of the packed B block (a multiple of `GEMM_NR`). */
+#define GEMM_NC 1024
+
+/**
+ * Products with fewer multiply-add operations than this value are computed
+ * directly, because packing does not pay off for them.
+ */
+#define GEMM_SMALL 32768
+
+/**
+ * Products with fewer multiply-add operations than this value are computed on
+ * the calling thread, because waking up the thread pool does not pay off for
+ * them.
+ */
+#define GEMM_PARALLEL 1048576
+
+/**
+ * The operations applied to C after the product has been computed.
+ */
+typedef struct GemmEpilogue
+{
+    /**
+     * The bias added to C, or NULL for no bias. The bias is a (m × n) matrix
+     * given with its strides like the other matrices. A zero stride repeats
+     * the same values along that dimension.
+     */
+    const Scalar *bias;
+
+    /**
+     * The row stride of the bias.
+     */
+    int rsBias;
+
+    /**
+     * The column stride of the bias.
+     */
+    int csBias;
+
+    /**
+     * The code of the activation function applied to C after the bias has
+     * been added (see activation.h).
+     */
+    int activation;
+} GemmEpilogue;
+
+/**
+ * Computes C = A x B, where A is (`m` × `k`), B is (`k` × `n`), and C is
+ * (`m` × `n`). Every matrix is given with its row stride (`rs`) and column
+ * stride (`cs`), so the element (i, j) of A is at `a[i * rsa + j * csa]`.
+ * The previous content of C is overwritten. If `epilogue` is not NULL, it is
+ * applied to the result.
+ */
+void gemm(
+    int m, int n, int k,
+    const Scalar *a, int rsa, int csa,
+    const Scalar *b, int rsb, int csb,
+    Scalar *c, int rsc, int csc,
+    const GemmEpilogue *epilogue);
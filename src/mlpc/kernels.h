@@ -0,0 +1,356 @@
+/**
+ * \file   kernels.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Kernel templates for the SIMD unit
+ *
+ * This file is not a regular header. It is included by simd.c once for every
+ * supported instruction set, each time with a different target selected for
+ * the compiler and with the `KERNEL(name)` macro defined to give the functions
+ * a unique suffix. The loops are written so that the compiler can vectorize
+ * them for the selected target.
+ *
+ * When compiled with GCC or Clang, the micro-kernel keeps its register tile in
+ * vectors of `KERNEL_VECTOR` bytes, which must be defined before inclusion.
+ */
+
+static void KERNEL(sum)(const Scalar *a, const Scalar *b, Scalar *dst, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = a[i] + b[i];
+}
+
+static void KERNEL(add)(Scalar *dst, const Scalar *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] += src[i];
+}
+
+static void KERNEL(difference)(const Scalar *a, const Scalar *b, Scalar *dst, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = a[i] - b[i];
+}
+
+static void KERNEL(subtract)(Scalar *dst, const Scalar *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] -= src[i];
+}
+
+static void KERNEL(multiply)(Scalar *dst, Scalar value, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] *= value;
+}
+
+static void KERNEL(divide)(Scalar *dst, Scalar value, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] /= value;
+}
+
+static void KERNEL(odot)(Scalar *dst, const Scalar *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] *= src[i];
+}
+
+static void KERNEL(fill)(Scalar *dst, Scalar value, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = value;
+}
+
+static void KERNEL(lerp)(Scalar *restrict dst, const Scalar *restrict src, Scalar t, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] += t * (src[i] - dst[i]);
+}
+
+/* Sums the rows of a (rows × columns) matrix into a vector of length `columns`. */
+static void KERNEL(sumColumns)(const Scalar *src, int rows, int columns, Scalar *dst)
+{
+    for (int col = 0; col < columns; col++)
+        dst[col] = 0;
+
+    for (int row = 0; row < rows; row++)
+    {
+        const Scalar *p = src + row * columns;
+        for (int col = 0; col < columns; col++)
+            dst[col] += p[col];
+    }
+}
+
+/*
+   Adds the bias and applies the activation function to a (m × n) block of C.
+   The activation code is resolved once, so each loop evaluates the function
+   inline.
+*/
+static void KERNEL(gemmEpilogue)(Scalar *c, int rsc, int csc, int m, int n, const GemmEpilogue *epilogue)
+{
+    if (epilogue->bias != NULL)
+    {
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < n; j++)
+                c[i * rsc + j * csc] += epilogue->bias[i * epilogue->rsBias + j * epilogue->csBias];
+    }
+
+    switch (epilogue->activation)
+    {
+        case ACTIVATION_SIGMOID:
+            for (int i = 0; i < m; i++)
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    Scalar x = c[i * rsc + j * csc];
+                    c[i * rsc + j * csc] = x >= 0 ? (Scalar)(1.0 / (1 + exp(-x))) : (Scalar)(exp(x) / (1 + exp(x)));
+                }
+            }
+            break;
+
+        case ACTIVATION_TANH:
+            for (int i = 0; i < m; i++)
+                for (int j = 0; j < n; j++)
+                    c[i * rsc + j * csc] = (Scalar)tanh(c[i * rsc + j * csc]);
+            break;
+
+        case ACTIVATION_RELU:
+            for (int i = 0; i < m; i++)
+                for (int j = 0; j < n; j++)
+                    c[i * rsc + j * csc] = c[i * rsc + j * csc] >= 0 ? c[i * rsc + j * csc] : 0;
+            break;
+    }
+}
+
+/*
+   The GEMM micro-kernel, see gemm.c. The tile is completed (accumulated with C
+   and passed through the epilogue) before it is stored.
+*/
+static void KERNEL(gemmKernel)(
+    int kc, const Scalar *a, const Scalar *b,
+    Scalar *c, int rsc, int csc,
+    int mr, int nr, int accumulate,
+    const GemmEpilogue *epilogue)
+{
+#if defined(__GNUC__)
+    typedef Scalar Vector __attribute__((vector_size(KERNEL_VECTOR), aligned(sizeof(Scalar))));
+    #define KERNEL_LANES (KERNEL_VECTOR / (int)sizeof(Scalar))
+
+    Vector ab[GEMM_MR][GEMM_NR / KERNEL_LANES] = { { { 0 } } };
+    for (int p = 0; p < kc; p++)
+    {
+        for (int i = 0; i < GEMM_MR; i++)
+            for (int j = 0; j < GEMM_NR / KERNEL_LANES; j++)
+                ab[i][j] += a[i] * *(const Vector *)(b + j * KERNEL_LANES);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    Scalar *tile = (Scalar *)ab;
+    #undef KERNEL_LANES
+#else
+    Scalar ab[GEMM_MR][GEMM_NR] = { { 0 } };
+    for (int p = 0; p < kc; p++)
+    {
+        for (int i = 0; i < GEMM_MR; i++)
+            for (int j = 0; j < GEMM_NR; j++)
+                ab[i][j] += a[i] * b[j];
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    Scalar *tile = (Scalar *)ab;
+#endif
+
+    if (accumulate)
+    {
+        for (int i = 0; i < mr; i++)
+            for (int j = 0; j < nr; j++)
+                tile[i * GEMM_NR + j] += c[i * rsc + j * csc];
+    }
+
+    if (epilogue != NULL)
+        KERNEL(gemmEpilogue)(tile, GEMM_NR, 1, mr, nr, epilogue);
+
+    for (int i = 0; i < mr; i++)
+        for (int j = 0; j < nr; j++)
+            c[i * rsc + j * csc] = tile[i * GEMM_NR + j];
+}
+
+/*
+   Computes y = W x for a (rows × columns) matrix W and passes y through the
+   epilogue. Four rows are processed at once, so each vector of x is loaded
+   once for four independent accumulators.
+*/
+static void KERNEL(gemv)(int rows, int columns, const Scalar *w, const Scalar *x, Scalar *y, const GemmEpilogue *epilogue)
+{
+    int r = 0;
+#if defined(__GNUC__)
+    typedef Scalar Vector __attribute__((vector_size(KERNEL_VECTOR), aligned(sizeof(Scalar))));
+    #define KERNEL_LANES (KERNEL_VECTOR / (int)sizeof(Scalar))
+
+    int vectorColumns = columns - columns % KERNEL_LANES;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const Scalar *w0 = w + r * columns;
+        const Scalar *w1 = w0 + columns;
+        const Scalar *w2 = w1 + columns;
+        const Scalar *w3 = w2 + columns;
+
+        Vector s0 = { 0 }, s1 = { 0 }, s2 = { 0 }, s3 = { 0 };
+        for (int i = 0; i < vectorColumns; i += KERNEL_LANES)
+        {
+            Vector v = *(const Vector *)(x + i);
+            s0 += *(const Vector *)(w0 + i) * v;
+            s1 += *(const Vector *)(w1 + i) * v;
+            s2 += *(const Vector *)(w2 + i) * v;
+            s3 += *(const Vector *)(w3 + i) * v;
+        }
+
+        Scalar sum[4] = { 0, 0, 0, 0 };
+        for (int lane = 0; lane < KERNEL_LANES; lane++)
+        {
+            sum[0] += s0[lane];
+            sum[1] += s1[lane];
+            sum[2] += s2[lane];
+            sum[3] += s3[lane];
+        }
+        for (int i = vectorColumns; i < columns; i++)
+        {
+            sum[0] += w0[i] * x[i];
+            sum[1] += w1[i] * x[i];
+            sum[2] += w2[i] * x[i];
+            sum[3] += w3[i] * x[i];
+        }
+
+        y[r] = sum[0];
+        y[r + 1] = sum[1];
+        y[r + 2] = sum[2];
+        y[r + 3] = sum[3];
+    }
+    #undef KERNEL_LANES
+#endif
+
+    for (; r < rows; r++)
+    {
+        const Scalar *wr = w + r * columns;
+        Scalar sum = 0;
+        for (int i = 0; i < columns; i++)
+            sum += wr[i] * x[i];
+        y[r] = sum;
+    }
+
+    if (epilogue != NULL)
+        KERNEL(gemmEpilogue)(y, rows, 1, 1, rows, epilogue);
+}
+
+/* One Adam step. The loop has no dependencies between elements, so it is fully vectorized. */
+static void KERNEL(adam)(
+    Scalar *restrict w, const Scalar *restrict g, Scalar *restrict m, Scalar *restrict v,
+    int n, const AdamCoefficients *coefficients)
+{
+    Scalar beta1 = coefficients->beta1;
+    Scalar beta2 = coefficients->beta2;
+    Scalar rest1 = 1 - beta1;
+    Scalar rest2 = 1 - beta2;
+    Scalar stepSize = coefficients->stepSize;
+    Scalar correction = coefficients->correction;
+    Scalar epsilon = coefficients->epsilon;
+
+    for (int i = 0; i < n; i++)
+    {
+        Scalar mi = beta1 * m[i] + rest1 * g[i];
+        Scalar vi = beta2 * v[i] + rest2 * g[i] * g[i];
+        m[i] = mi;
+        v[i] = vi;
+#ifdef MLPC_FLOAT
+        w[i] -= stepSize * mi / (sqrtf(vi) * correction + epsilon);
+#else
+        w[i] -= stepSize * mi / (sqrt(vi) * correction + epsilon);
+#endif
+    }
+}
+
+/*
+   Fills `blocks` blocks of RANDOM_LANES values with uniform random numbers from
+   [low, low + scale). The xoshiro256+ generators of the lanes are stored one
+   state word after another, so each step is a vector operation over the lanes.
+   The top bits of each result are turned into a number from [1, 2) by setting
+   the exponent bits, which avoids the integer to floating point conversion.
+*/
+static void KERNEL(randomUniform)(uint64_t *restrict state, Scalar *restrict dst, int blocks, Scalar low, Scalar scale)
+{
+    uint64_t *s0 = state;
+    uint64_t *s1 = state + RANDOM_LANES;
+    uint64_t *s2 = state + 2 * RANDOM_LANES;
+    uint64_t *s3 = state + 3 * RANDOM_LANES;
+
+    for (int block = 0; block < blocks; block++)
+    {
+        Scalar *d = dst + block * RANDOM_LANES;
+        for (int lane = 0; lane < RANDOM_LANES; lane++)
+        {
+            uint64_t result = s0[lane] + s3[lane];
+            uint64_t t = s1[lane] << 17;
+            s2[lane] ^= s0[lane];
+            s3[lane] ^= s1[lane];
+            s1[lane] ^= s2[lane];
+            s0[lane] ^= s3[lane];
+            s2[lane] ^= t;
+            s3[lane] = (s3[lane] << 45) | (s3[lane] >> 19);
+
+#ifdef MLPC_FLOAT
+            uint32_t bits = (uint32_t)(result >> 41) | 0x3F800000u;
+#else
+            uint64_t bits = (result >> 12) | 0x3FF0000000000000ull;
+#endif
+            Scalar u;
+            memcpy(&u, &bits, sizeof(Scalar));
+            d[lane] = low + scale * (u - 1);
+        }
+    }
+}
+
+/* The integer matrix product for quantized MLPs. Each weight row is loaded once for SIMD_INT8_SAMPLES samples. */
+static void KERNEL(gemmInt8)(const uint8_t *x, int samples, const int8_t *w, int rows, int n, int32_t *out, int rso)
+{
+    int s = 0;
+    for (; s + SIMD_INT8_SAMPLES <= samples; s += SIMD_INT8_SAMPLES)
+    {
+        const uint8_t *x0 = x + s * n;
+        const uint8_t *x1 = x0 + n;
+        const uint8_t *x2 = x1 + n;
+        const uint8_t *x3 = x2 + n;
+        for (int r = 0; r < rows; r++)
+        {
+            const int8_t *wr = w + r * n;
+            int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+            for (int i = 0; i < n; i++)
+            {
+                int32_t weight = wr[i];
+                sum0 += (int32_t)x0[i] * weight;
+                sum1 += (int32_t)x1[i] * weight;
+                sum2 += (int32_t)x2[i] * weight;
+                sum3 += (int32_t)x3[i] * weight;
+            }
+            out[s * rso + r] = sum0;
+            out[(s + 1) * rso + r] = sum1;
+            out[(s + 2) * rso + r] = sum2;
+            out[(s + 3) * rso + r] = sum3;
+        }
+    }
+
+    for (; s < samples; s++)
+    {
+        const uint8_t *xs = x + s * n;
+        for (int r = 0; r < rows; r++)
+        {
+            const int8_t *wr = w + r * n;
+            int32_t sum = 0;
+            for (int i = 0; i < n; i++)
+                sum += (int32_t)xs[i] * wr[i];
+            out[s * rso + r] = sum;
+        }
+    }
+}
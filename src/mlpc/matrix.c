@@ -1,13 +1,16 @@
+#include <stdlib.h>
 #include <malloc.h>
 #include "matrix.h"
 #include "random.h"
+#include "gemm.h"
+#include "simd.h"
 
 Matrix matrix_create(int rows, int columns)
 {
     Matrix matrix;
     matrix.rows = rows;
     matrix.columns = columns;
-    matrix.data = malloc(rows * columns * sizeof(double));
+    matrix.data = malloc((size_t)rows * columns * sizeof(Scalar));
     
     return matrix;
 }
@@ -17,14 +20,43 @@ Matrix matrix_clone(Matrix matrix)
     Matrix clone;
     clone.rows = matrix.rows;
     clone.columns = matrix.columns;
-    clone.data = malloc(matrix.rows * matrix.columns * sizeof(double));
+    clone.data = malloc((size_t)matrix.rows * matrix.columns * sizeof(Scalar));
 
-    for (int i = 0; i < matrix.rows * matrix.columns; i++)
+    for (size_t i = 0; i < (size_t)matrix.rows * matrix.columns; i++)
         clone.data[i] = matrix.data[i];
     
     return clone;
 }
 
+Matrix matrix_rows(Matrix matrix, int row, int rows)
+{
+    Matrix view;
+    view.rows = rows;
+    view.columns = matrix.columns;
+    view.data = matrix.data + row * matrix.columns;
+    return view;
+}
+
+Scalar *matrix_aligned_alloc(int count)
+{
+#ifdef _MSC_VER
+    return _aligned_malloc(count * sizeof(Scalar), MATRIX_ALIGNMENT);
+#else
+    /* The size must be a multiple of the alignment. */
+    size_t size = ((size_t)count * sizeof(Scalar) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    return aligned_alloc(MATRIX_ALIGNMENT, size);
+#endif
+}
+
+void matrix_aligned_free(Scalar *data)
+{
+#ifdef _MSC_VER
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
 Matrix matrix_load(const char *filename)
 {
     Matrix matrix;
@@ -42,7 +74,46 @@ Matrix matrix_load(const char *filename)
     return matrix;
 }
 
+/* Reads n elements of the given size in bytes and converts them to Scalar. */
+int matrix_read_elements(Scalar *data, int n, int size, FILE *file)
+{
+    if (size == sizeof(Scalar))
+        return fread(data, sizeof(Scalar), n, file) == n ? 0 : -1;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (size == sizeof(double))
+        {
+            double value;
+            if (fread(&value, sizeof(double), 1, file) != 1)
+                return -1;
+            data[i] = (Scalar)value;
+        }
+        else
+        {
+            float value;
+            if (fread(&value, sizeof(float), 1, file) != 1)
+                return -1;
+            data[i] = (Scalar)value;
+        }
+    }
+
+    return 0;
+}
+
 Matrix matrix_read(FILE *file)
+{
+    int tag;
+    if (fread(&tag, sizeof(int), 1, file) != 1)
+    {
+        Matrix matrix = { 0, 0, NULL };
+        return matrix;
+    }
+
+    return matrix_read_tagged(tag, file);
+}
+
+Matrix matrix_read_tagged(int tag, FILE *file)
 {
     Matrix matrix;
     matrix.rows = 0;
@@ -50,10 +121,20 @@ Matrix matrix_read(FILE *file)
     matrix.data = NULL;
 
     int columns, rows, n;
-    double *data;
+    int size = sizeof(double);
+    Scalar *data;
 
-    if (fread(&rows, sizeof(int), 1, file) != 1)
-        return matrix;
+    /* Files without the precision tag start with the number of rows. */
+    if (tag < 0)
+    {
+        size = -tag;
+        if (size != sizeof(double) && size != sizeof(float))
+            return matrix;
+        if (fread(&rows, sizeof(int), 1, file) != 1)
+            return matrix;
+    }
+    else
+        rows = tag;
     
     if (fread(&columns, sizeof(int), 1, file) != 1)
         return matrix;
@@ -61,10 +142,10 @@ Matrix matrix_read(FILE *file)
     if ((n = rows * columns) <= 0)
         return matrix;
     
-    if ((data = malloc(n * sizeof(double))) == NULL)
+    if ((data = malloc(n * sizeof(Scalar))) == NULL)
         return matrix;
     
-    if (fread(data, sizeof(double), n, file) != n)
+    if (matrix_read_elements(data, n, size, file) != 0)
     {
         free(data);
         return matrix;
@@ -91,6 +172,10 @@ int matrix_save(Matrix matrix, const char *filename)
 
 int matrix_write(Matrix matrix, FILE *file)
 {
+    int tag = -(int)sizeof(Scalar);
+    if (fwrite(&tag, sizeof(int), 1, file) != 1)
+        return -1;
+
     if (fwrite(&matrix.rows, sizeof(int), 1, file) != 1)
         return -1;
     
@@ -98,7 +183,7 @@ int matrix_write(Matrix matrix, FILE *file)
         return -1;
     
     int n = matrix.rows * matrix.columns;
-    if (fwrite(matrix.data, sizeof(double), n, file) != n)
+    if (fwrite(matrix.data, sizeof(Scalar), n, file) != n)
         return -1;
 
     return 0;
@@ -124,77 +209,91 @@ void matrix_copy(Matrix dst, Matrix src)
 
 void matrix_fill(Matrix matrix, double value)
 {
-    for (int i = 0; i < matrix.rows * matrix.columns; i++)
-        matrix.data[i] = value;
+    simd.fill(matrix.data, (Scalar)value, matrix.rows * matrix.columns);
 }
 
 void matrix_randomize(Matrix matrix, double min, double max)
 {
-    for (int i = 0; i < matrix.rows * matrix.columns; i++)
-        matrix.data[i] = deepc_random_double(min, max);
+    deepc_rng_fill_uniform(deepc_random_generator(), matrix.data, matrix.rows * matrix.columns, min, max);
 }
 
 void matrix_sum(Matrix matrix1, Matrix matrix2, Matrix result)
 {
-    for (int i = 0; i < result.rows * result.columns; i++)
-        result.data[i] = matrix1.data[i] + matrix2.data[i];
+    simd.sum(matrix1.data, matrix2.data, result.data, result.rows * result.columns);
 }
 
 void matrix_add(Matrix dst, Matrix src)
 {
-    for (int i = 0; i < dst.rows * dst.columns; i++)
-        dst.data[i] += src.data[i];
+    simd.add(dst.data, src.data, dst.rows * dst.columns);
 }
 
 void matrix_difference(Matrix matrix1, Matrix matrix2, Matrix result)
 {
-    for (int i = 0; i < result.rows * result.columns; i++)
-        result.data[i] = matrix1.data[i] - matrix2.data[i];
+    simd.difference(matrix1.data, matrix2.data, result.data, result.rows * result.columns);
 }
 
 void matrix_subtract(Matrix dst, Matrix src)
 {
-    for (int i = 0; i < dst.rows * dst.columns; i++)
-        dst.data[i] -= src.data[i];
+    simd.subtract(dst.data, src.data, dst.rows * dst.columns);
 }
 
 void matrix_multiply(Matrix matrix, double value)
 {
-    for (int i = 0; i < matrix.rows * matrix.columns; i++)
-        matrix.data[i] *= value;
+    simd.multiply(matrix.data, (Scalar)value, matrix.rows * matrix.columns);
 }
 
 void matrix_divide(Matrix matrix, double value)
 {
-    for (int i = 0; i < matrix.rows * matrix.columns; i++)
-        matrix.data[i] /= value;
+    simd.divide(matrix.data, (Scalar)value, matrix.rows * matrix.columns);
 }
 
 void matrix_odot(Matrix dst, Matrix src)
 {
-    for (int i = 0; i < dst.rows * dst.columns; i++)
-        dst.data[i] *= src.data[i];
+    simd.odot(dst.data, src.data, dst.rows * dst.columns);
+}
+
+void matrix_lerp(Matrix dst, Matrix src, double t)
+{
+    simd.lerp(dst.data, src.data, (Scalar)t, dst.rows * dst.columns);
 }
 
 void matrix_dot(Matrix matrix1, Matrix matrix2, Matrix result)
 {
-    double *p = result.data;
-    for (int row = 0; row < result.rows; row++)
-    {
-        for (int col = 0; col < result.columns; col++)
-        {
-            double *p1 = matrix1.data + matrix1.columns * row;
-            double *p2 = matrix2.data + col;
-            double sum = 0;
-            for (int k = 0; k < matrix1.columns; k++)
-            {
-                sum += *p1 * *p2;
-                p1 += 1;
-                p2 += matrix2.columns;
-            }
-            *(p++) = sum;
-        }
-    }
+    gemm(result.rows, result.columns, matrix1.columns,
+        matrix1.data, matrix1.columns, 1,
+        matrix2.data, matrix2.columns, 1,
+        result.data, result.columns, 1, NULL);
+}
+
+/* A transposed factor is read by swapping its strides. */
+static void matrix_gemm_epilogue(
+    Matrix matrix1, int transpose1, Matrix matrix2, int transpose2,
+    Matrix result, const GemmEpilogue *epilogue)
+{
+    gemm(result.rows, result.columns, transpose1 ? matrix1.rows : matrix1.columns,
+        matrix1.data, transpose1 ? 1 : matrix1.columns, transpose1 ? matrix1.columns : 1,
+        matrix2.data, transpose2 ? 1 : matrix2.columns, transpose2 ? matrix2.columns : 1,
+        result.data, result.columns, 1, epilogue);
+}
+
+void matrix_gemm(Matrix matrix1, int transpose1, Matrix matrix2, int transpose2, Matrix result)
+{
+    matrix_gemm_epilogue(matrix1, transpose1, matrix2, transpose2, result, NULL);
+}
+
+void matrix_gemm_add_apply(
+    Matrix matrix1, int transpose1, Matrix matrix2, int transpose2,
+    Matrix bias, int activationCode, Matrix result)
+{
+    /* The zero row stride repeats the bias for every row of the result. */
+    GemmEpilogue epilogue = { bias.data, 0, 1, activationCode };
+    matrix_gemm_epilogue(matrix1, transpose1, matrix2, transpose2, result, &epilogue);
+}
+
+void matrix_gemv_add_apply(Matrix x, Matrix weights, Matrix bias, int activationCode, Matrix result)
+{
+    GemmEpilogue epilogue = { bias.data, 0, 1, activationCode };
+    simd.gemv(weights.rows, weights.columns, weights.data, x.data, result.data, &epilogue);
 }
 
 void matrix_transpose(Matrix matrix, Matrix result)
@@ -206,38 +305,26 @@ void matrix_transpose(Matrix matrix, Matrix result)
 
 void matrix_dot_transpose(Matrix matrix1, Matrix matrix2, Matrix result)
 {
-    for (int col = 0; col < result.columns; col++)
-    {
-        for (int row = 0; row < result.rows; row++)
-        {
-            double *p1 = matrix1.data + matrix1.columns * col;
-            double *p2 = matrix2.data + row;
-            double sum = 0;
-            for (int k = 0; k < matrix1.columns; k++)
-            {
-                sum += *p1 * *p2;
-                p1 += 1;
-                p2 += matrix2.columns;
-            }
-            result.data[row * result.columns + col] = sum;
-        }
-    }
+    /* The result is written transposed by swapping its strides. */
+    gemm(result.columns, result.rows, matrix1.columns,
+        matrix1.data, matrix1.columns, 1,
+        matrix2.data, matrix2.columns, 1,
+        result.data, 1, result.columns, NULL);
 }
 
 void matrix_sum_rows_transpose(Matrix matrix, Matrix result)
 {
-    for (int col = 0; col < matrix.columns; col++)
-    {
-        int idx = col * result.columns;
-        result.data[idx] = 0;
-        for (int row = 0; row < matrix.rows; row++)
-            result.data[idx] += matrix.data[row * matrix.columns + col];
-    }
-    for (int col = 1; col < result.columns; col++)
-    {
-        for (int row = 0; row < result.rows; row++)
-            result.data[row * result.columns + col] = result.data[row * result.columns];
-    }
+    /* The column sums are first stored consecutively at the start of the
+       result. Filling the rows from the last one backwards then never
+       overwrites a sum that is still needed. */
+    simd.sumColumns(matrix.data, matrix.rows, matrix.columns, result.data);
+    for (int row = result.rows - 1; row >= 0; row--)
+        simd.fill(result.data + row * result.columns, result.data[row], result.columns);
+}
+
+void matrix_sum_rows(Matrix matrix, Matrix result)
+{
+    simd.sumColumns(matrix.data, matrix.rows, matrix.columns, result.data);
 }
 
 void matrix_apply(Matrix matrix, ActivationFunction activationFunction)
@@ -6,7 +6,7 @@
  *
  * This module provides a low-level implementation of 2D matrices. The matrices
  * are of fixed shape, which is determined upon matrix creation. Entries are
- * always of type double. Arithmetic operations are performed without checking
+ * of type Scalar (see scalar.h). Arithmetic operations are performed without checking
  * the validity of dimensions and it is up to the user to provide matrices of
  * valid shapes for the used operation. Memory violation may occur otherwise.
  * 
@@ -14,11 +14,19 @@
  * disposed by calling the matrix_destroy function.
  * 
  * The elements are stored in a continuous block of memory as an array of type
- * double. The element at (`row`, `col`) position can be be found at the
+ * Scalar. The element at (`row`, `col`) position can be be found at the
  * `[row * matrix.columns + col]` index in the array.
+ *
+ * In a binary file, a matrix is stored as a precision tag, followed by the
+ * number of rows, the number of columns and the elements. The precision tag
+ * is the negated size of the stored elements in bytes (-8 for double and -4
+ * for float), so a matrix saved by the double variant of the library can be
+ * loaded by the float variant and vice versa. Files without the tag, which
+ * start directly with the number of rows, are read as double.
  */
 
 #include <stdio.h>
+#include "scalar.h"
 #include "activation.h"
 
 /**
@@ -29,7 +37,7 @@
 
 /**
  * The matrix structure contains a pointer to the heap-allocated array of type
- * double. The number of rows and columns are stored as integers. This structure
+ * Scalar. The number of rows and columns are stored as integers. This structure
  * would typically be passed by value, which means the the shape information is
  * copied through stack, while the contents of the matrix remains on the heap.
  */
@@ -46,9 +54,9 @@ typedef struct Matrix {
 
     /**
      * The pointer to the data - an array that contains rows * columns values
-     * of type double.
+     * of type Scalar.
      */
-    double *data;
+    Scalar *data;
 } Matrix;
 
 /**
@@ -68,9 +76,38 @@ Matrix matrix_create(int rows, int columns);
  */
 Matrix matrix_clone(Matrix matrix);
 
+/**
+ * Returns a view of `rows` consecutive rows of the `matrix`, starting with
+ * the row `row`. The view shares its data with the `matrix`, so it must not be
+ * destroyed.
+ *
+ * \returns The view of the selected rows.
+ */
+Matrix matrix_rows(Matrix matrix, int row, int rows);
+
+/**
+ * The alignment in bytes of the arrays allocated by `matrix_aligned_alloc`.
+ * It matches the width of the widest vector registers.
+ */
+#define MATRIX_ALIGNMENT 64
+
+/**
+ * Allocates an array of `count` scalars, aligned to `MATRIX_ALIGNMENT` bytes.
+ * The array must eventually be freed by calling `matrix_aligned_free`.
+ *
+ * \returns The allocated array, or NULL if the allocation failed.
+ */
+Scalar *matrix_aligned_alloc(int count);
+
+/**
+ * Frees an array allocated by `matrix_aligned_alloc`.
+ */
+void matrix_aligned_free(Scalar *data);
+
 /**
  * Loads a matrix from a file. If the file cannot be read, an empty matrix is
- * created an returned. The returned matrix must eventually be destroyed by
+ * created an returned. Elements stored with a different precision are
+ * converted. The returned matrix must eventually be destroyed by
  * calling `matrix_destroy`.
  * 
  * \returns The newly created Matrix.
@@ -86,6 +123,23 @@ Matrix matrix_load(const char *filename);
  */
 Matrix matrix_read(FILE *file);
 
+/**
+ * Works like `matrix_read`, but for a stream from which the first integer of
+ * the matrix has already been read and is given as `tag`. This is used by
+ * readers that must inspect the start of a stream to recognize its format.
+ *
+ * \returns The newly created Matrix.
+ */
+Matrix matrix_read_tagged(int tag, FILE *file);
+
+/**
+ * Reads `n` values that were stored with `size` bytes each (the size of a
+ * float or a double) and converts them to Scalar.
+ *
+ * \returns 0 if no errors, -1 if errors.
+ */
+int matrix_read_elements(Scalar *data, int n, int size, FILE *file);
+
 /**
  * Stores the content of the matrix to a binary file.
  * 
@@ -168,6 +222,13 @@ void matrix_divide(Matrix matrix, double value);
  */
 void matrix_odot(Matrix dst, Matrix src);
 
+/**
+ * Moves the elements of the `dst` matrix towards the elements of the `src`
+ * matrix by the fraction `t`, i.e., dst = t * src + (1 - t) * dst. Both
+ * matrices must be of the same shape.
+ */
+void matrix_lerp(Matrix dst, Matrix src, double t);
+
 /**
  * Multiplies matrices `matrix1` and `matrix2' and stores the result to
  * the `result` matrix. The shape of the given matrices must be in
@@ -175,9 +236,42 @@ void matrix_odot(Matrix dst, Matrix src);
  * of columns of `matrix1` must be equal to the number of rows of
  * `matrix2`. The `result` matrix must have the same number of rows
  * as `matrix1` and the same number of columns as `matrix2`.
+ *
+ * The product is computed by the blocked GEMM engine (see gemm.h).
  */
 void matrix_dot(Matrix matrix1, Matrix matrix2, Matrix result);
 
+/**
+ * Multiplies matrices `matrix1` and `matrix2` and stores the result to the
+ * `result` matrix, where each of the factors is used transposed if its
+ * `transpose` flag is nonzero. The matrices are never transposed in memory,
+ * the GEMM engine reads them in the required order. The shapes must comply
+ * with the matrix multiplication rule after the transpositions.
+ */
+void matrix_gemm(Matrix matrix1, int transpose1, Matrix matrix2, int transpose2, Matrix result);
+
+/**
+ * Works like `matrix_gemm`, but also adds the `bias` row to every row of the
+ * product and applies the activation function given by `activationCode` (see
+ * activation.h) to every element. The bias and the activation are applied to
+ * each block of the product while it is still in the cache, which avoids two
+ * additional passes over the `result`. The `bias` must be a single row with
+ * the same number of columns as the `result`.
+ */
+void matrix_gemm_add_apply(
+    Matrix matrix1, int transpose1, Matrix matrix2, int transpose2,
+    Matrix bias, int activationCode, Matrix result);
+
+/**
+ * Computes `result` = activation(`x` x `weights`^T + `bias`) for a single row
+ * `x`, where the activation is given by `activationCode`. The `bias` and the
+ * `result` are single rows with as many columns as there are rows in the
+ * `weights` matrix. This is the special case of `matrix_gemm_add_apply` for
+ * one sample, computed with a matrix-vector product, which is faster than the
+ * blocked GEMM for a single row.
+ */
+void matrix_gemv_add_apply(Matrix x, Matrix weights, Matrix bias, int activationCode, Matrix result);
+
 /**
  * Transposes the `matrix` and stores the transposed content to the
  * `result` matrix.
@@ -206,6 +300,12 @@ void matrix_dot_transpose(Matrix matrix1, Matrix matrix2, Matrix result);
  */
 void matrix_sum_rows_transpose(Matrix matrix, Matrix result);
 
+/**
+ * Sums all the rows of the `matrix`, i.e., sums all the elements in the same
+ * column, and stores the sums to the single-row `result` matrix.
+ */
+void matrix_sum_rows(Matrix matrix, Matrix result);
+
 /**
  * Applies the given activation function to every element in the `matrix`.
  */
@@ -3,79 +3,208 @@
 #include "random.h"
 #include "mlp.h"
 #include "loss.h"
+#include "simd.h"
+#include "gemm.h"
+#include "threadpool.h"
 
 /* Initialize the MLPC library. */
 void mlp_init()
 {
     deepc_random_init();
+    simd_init(SIMD_AUTO);
 }
 
-/* A helper function to create a layer. */
-Layer mlp_create_layer(int inputSize, int outputSize, int batchSize, int activation)
+/* Initialize the MLPC library with a pool of worker threads. */
+int mlp_init_threads(int threads)
 {
-    Layer layer;
-    layer.weights = matrix_create(outputSize, inputSize);
-    layer.biases = matrix_create(outputSize, batchSize);
-    layer.output = matrix_create(outputSize, batchSize);
-    layer.errors = matrix_create(batchSize, outputSize);
-    layer.deltas = matrix_create(batchSize, outputSize);
-    layer.gradWeights = matrix_create(outputSize, inputSize);
-    layer.gradBiases = matrix_create(outputSize, batchSize);
-    layer.activation = getActivationFunction(activation);
-    layer.activationDeriv = getActivationFunctionDeriv(activation);
-    
-    return layer;
+    mlp_init();
+    return threadpool_init(threads);
 }
 
-/* Creates a new neural network on heap. */
-MLP *mlp_create(int inputSize, int outputSize, int depth, int *hiddenLayerSizes, int hiddenLayerActivation, int outputLayerActivation, int batchSize)
+/* Every layer takes part in products of (batch size × its inputs × its outputs) multiply-adds. */
+int mlp_is_parallel(MLP *mlp, int batchSize)
+{
+    if (threadpool_size() == 1)
+        return 0;
+
+    for (int l = 0; l <= mlp->depth; l++)
+    {
+        Matrix weights = mlp->layers[l].weights;
+        if ((double)batchSize * weights.rows * weights.columns >= GEMM_PARALLEL)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* The tasks are run by the worker pool, or on the calling thread if the pool is busy. */
+void mlp_run_parallel(MLPTask task, void *arg, int count)
+{
+    threadpool_run(task, arg, count);
+}
+
+/* Forces the use of the kernels for the given instruction set. */
+int mlp_set_simd_level(int level)
+{
+    return simd_init(level);
+}
+
+/* Returns the instruction set of the kernels in use. */
+int mlp_get_simd_level()
+{
+    return simd_level();
+}
+
+/*
+   Allocates a neural network with the given layer sizes (depth + 2 values, starting
+   with the input size) and activation codes (depth + 1 values). All the weights and
+   biases are stored in one array, layer by layer, and the gradients in another one
+   with the same layout. The layer matrices are views into these two arrays.
+
+   An inference-only network gets no gradients and no back-propagation buffers. Its
+   layers alternate between two scratch buffers that are wide enough for any layer.
+*/
+static MLP *mlp_allocate(int depth, const int *sizes, const int *activations, int batchSize, int trainable)
 {
     MLP *mlp = malloc(sizeof(MLP));
     mlp->depth = depth;
     mlp->batchSize = batchSize;
+    mlp->trainable = trainable;
+    mlp->rows = batchSize;
     mlp->layers = malloc((depth + 1) * sizeof(Layer));
-    
-    int layerInputSize = inputSize;
+
+    mlp->parameterCount = 0;
+    int width = 0;
+    for (int i = 0; i <= depth; i++)
+    {
+        mlp->parameterCount += (sizes[i] + 1) * sizes[i + 1];
+        if (sizes[i + 1] > width)
+            width = sizes[i + 1];
+    }
+
+    mlp->parameters = matrix_aligned_alloc(mlp->parameterCount);
+    mlp->gradients = trainable ? matrix_aligned_alloc(mlp->parameterCount) : NULL;
+    mlp->scratch = trainable ? NULL : matrix_aligned_alloc(2 * batchSize * width);
+
+    Matrix empty = { 0, 0, NULL };
+
+    int offset = 0;
+    for (int i = 0; i <= depth; i++)
+    {
+        Layer *layer = &mlp->layers[i];
+        int inputSize = sizes[i];
+        int outputSize = sizes[i + 1];
+
+        int biasOffset = offset + outputSize * inputSize;
+
+        layer->weights = (Matrix){ outputSize, inputSize, mlp->parameters + offset };
+        layer->biases = (Matrix){ 1, outputSize, mlp->parameters + biasOffset };
+
+        if (trainable)
+        {
+            layer->gradWeights = (Matrix){ outputSize, inputSize, mlp->gradients + offset };
+            layer->gradBiases = (Matrix){ 1, outputSize, mlp->gradients + biasOffset };
+            layer->output = matrix_create(batchSize, outputSize);
+            layer->errors = matrix_create(batchSize, outputSize);
+            layer->deltas = matrix_create(batchSize, outputSize);
+        }
+        else
+        {
+            layer->gradWeights = layer->gradBiases = empty;
+            layer->output = (Matrix){ batchSize, outputSize, mlp->scratch + (i % 2) * batchSize * width };
+            layer->errors = layer->deltas = empty;
+        }
+
+        layer->activationCode = activations[i];
+        layer->activation = getActivationFunction(activations[i]);
+        layer->activationDeriv = getActivationFunctionDeriv(activations[i]);
+
+        offset = biasOffset + outputSize;
+    }
+
+    mlp->input = trainable ? matrix_create(batchSize, sizes[0]) : empty;
+    mlp->inputErrors = trainable ? matrix_create(batchSize, sizes[0]) : empty;
+    mlp->output = mlp->layers[depth].output;
+
+    return mlp;
+}
+
+/* Fills the given arrays with the layer sizes and activation codes of the neural network. */
+static void mlp_get_architecture(MLP *mlp, int *sizes, int *activations)
+{
+    sizes[0] = mlp->layers[0].weights.columns;
+    for (int i = 0; i <= mlp->depth; i++)
+    {
+        sizes[i + 1] = mlp->layers[i].weights.rows;
+        activations[i] = mlp->layers[i].activationCode;
+    }
+}
+
+/* Allocates a neural network with the given hidden layers and initializes its weights. */
+static MLP *mlp_create_layers(int inputSize, int outputSize, int depth, int *hiddenLayerSizes, int hiddenLayerActivation, int outputLayerActivation, int batchSize, int trainable)
+{
+    int *sizes = malloc((depth + 2) * sizeof(int));
+    int *activations = malloc((depth + 1) * sizeof(int));
+
+    sizes[0] = inputSize;
     for (int i = 0; i < depth; i++)
     {
-        mlp->layers[i] = mlp_create_layer(layerInputSize, hiddenLayerSizes[i], batchSize, hiddenLayerActivation);
-        layerInputSize = hiddenLayerSizes[i];
+        sizes[i + 1] = hiddenLayerSizes[i];
+        activations[i] = hiddenLayerActivation;
     }
-    mlp->layers[depth] = mlp_create_layer(layerInputSize, outputSize, batchSize, outputLayerActivation);
+    sizes[depth + 1] = outputSize;
+    activations[depth] = outputLayerActivation;
 
-    mlp->input = matrix_create(inputSize, batchSize);
-    mlp->inputErrors = matrix_create(batchSize, inputSize);
-    mlp->output = matrix_create(batchSize, outputSize);
+    MLP *mlp = mlp_allocate(depth, sizes, activations, batchSize, trainable);
+    free(sizes);
+    free(activations);
 
     mlp_initialize(mlp);
     
     return mlp;
 }
 
+/* Creates a new neural network on heap. */
+MLP *mlp_create(int inputSize, int outputSize, int depth, int *hiddenLayerSizes, int hiddenLayerActivation, int outputLayerActivation, int batchSize)
+{
+    return mlp_create_layers(inputSize, outputSize, depth, hiddenLayerSizes, hiddenLayerActivation, outputLayerActivation, batchSize, 1);
+}
+
+/* Creates a new neural network on heap that can only be used for inference. */
+MLP *mlp_create_inference(int inputSize, int outputSize, int depth, int *hiddenLayerSizes, int hiddenLayerActivation, int outputLayerActivation, int batchSize)
+{
+    return mlp_create_layers(inputSize, outputSize, depth, hiddenLayerSizes, hiddenLayerActivation, outputLayerActivation, batchSize, 0);
+}
+
+/* Allocates a neural network with the same architecture as the given one. */
+static MLP *mlp_allocate_like(MLP *mlp, int trainable)
+{
+    int *sizes = malloc((mlp->depth + 2) * sizeof(int));
+    int *activations = malloc((mlp->depth + 1) * sizeof(int));
+    mlp_get_architecture(mlp, sizes, activations);
+
+    MLP *clone = mlp_allocate(mlp->depth, sizes, activations, mlp->batchSize, trainable);
+    free(sizes);
+    free(activations);
+
+    return clone;
+}
+
 /* Creates a new neural network on heap that is a clone of the given neural network. */
 MLP *mlp_clone(MLP *mlp)
 {
-    MLP *clone = malloc(sizeof(MLP));
-    clone->depth = mlp->depth;
-    clone->batchSize = mlp->batchSize;
-    clone->layers = malloc((mlp->depth + 1) * sizeof(Layer));
+    MLP *clone = mlp_allocate_like(mlp, mlp->trainable);
+    mlp_copy(clone, mlp);
+    clone->rows = mlp->rows;
 
-    for (int i = 0; i <= mlp->depth; i++)
-    {
-        clone->layers[i].weights = matrix_clone(mlp->layers[i].weights);
-        clone->layers[i].biases = matrix_clone(mlp->layers[i].biases);
-        clone->layers[i].output = matrix_clone(mlp->layers[i].output);
-        clone->layers[i].errors = matrix_clone(mlp->layers[i].errors);
-        clone->layers[i].deltas = matrix_clone(mlp->layers[i].deltas);
-        clone->layers[i].gradWeights = matrix_clone(mlp->layers[i].gradWeights);
-        clone->layers[i].gradBiases = matrix_clone(mlp->layers[i].gradBiases);
-        clone->layers[i].activation = mlp->layers[i].activation;
-        clone->layers[i].activationDeriv = mlp->layers[i].activationDeriv;
-    }
+    return clone;
+}
 
-    clone->input = matrix_clone(mlp->input);
-    clone->inputErrors = matrix_clone(mlp->inputErrors);
-    clone->output = matrix_clone(mlp->output);
+/* Creates an inference-only neural network with the parameters of the given neural network. */
+MLP *mlp_clone_inference(MLP *mlp)
+{
+    MLP *clone = mlp_allocate_like(mlp, 0);
+    mlp_copy_params(clone, mlp);
 
     return clone;
 }
@@ -83,68 +212,94 @@ MLP *mlp_clone(MLP *mlp)
 /* Destroys a neural network created with mlp_create or mlp_clone. */
 void mlp_destroy(MLP *mlp)
 {
-    for (int i = 0; i <= mlp->depth; i++)
+    if (mlp->trainable)
     {
-        matrix_destroy(mlp->layers[i].weights);
-        matrix_destroy(mlp->layers[i].biases);
-        matrix_destroy(mlp->layers[i].output);
-        matrix_destroy(mlp->layers[i].errors);
-        matrix_destroy(mlp->layers[i].deltas);
-        matrix_destroy(mlp->layers[i].gradWeights);
-        matrix_destroy(mlp->layers[i].gradBiases);
+        for (int i = 0; i <= mlp->depth; i++)
+        {
+            matrix_destroy(mlp->layers[i].output);
+            matrix_destroy(mlp->layers[i].errors);
+            matrix_destroy(mlp->layers[i].deltas);
+        }
+
+        matrix_destroy(mlp->input);
+        matrix_destroy(mlp->inputErrors);
+        matrix_aligned_free(mlp->gradients);
     }
+    else
+        matrix_aligned_free(mlp->scratch);
 
-    matrix_destroy(mlp->input);
-    matrix_destroy(mlp->inputErrors);
-    matrix_destroy(mlp->output);
-
+    matrix_aligned_free(mlp->parameters);
     free(mlp->layers);
     free(mlp);
 }
 
+/* Returns the parameters of the neural network as a single row matrix. */
+static Matrix mlp_parameter_matrix(MLP *mlp)
+{
+    return (Matrix){ 1, mlp->parameterCount, mlp->parameters };
+}
+
+/* Returns the gradients of the neural network as a single row matrix. */
+static Matrix mlp_gradient_matrix(MLP *mlp)
+{
+    return (Matrix){ 1, mlp->parameterCount, mlp->gradients };
+}
+
 /* Clears all existing values and sets random weights using the Glorot method. */
 void mlp_initialize(MLP *mlp)
 {
+    matrix_clear(mlp_parameter_matrix(mlp));
+    if (mlp->trainable)
+        matrix_clear(mlp_gradient_matrix(mlp));
+
     for (int i = 0; i <= mlp->depth; i++)
     {        
         double limit = sqrt(6.0 / (double)(mlp->layers[i].weights.rows + mlp->layers[i].weights.columns));
-        double *data = mlp->layers[i].weights.data;
-        for (int k = 0; k < mlp->layers[i].weights.rows * mlp->layers[i].weights.columns; k++)
-            data[k] = deepc_random_double(-limit, limit);
+        matrix_randomize(mlp->layers[i].weights, -limit, limit);
         
-        matrix_clear(mlp->layers[i].biases);
         matrix_clear(mlp->layers[i].output);
         matrix_clear(mlp->layers[i].errors);
         matrix_clear(mlp->layers[i].deltas);
-        matrix_clear(mlp->layers[i].gradWeights);
-        matrix_clear(mlp->layers[i].gradBiases);
     }
 
     matrix_clear(mlp->input);
     matrix_clear(mlp->inputErrors);
-    matrix_clear(mlp->output);
 }
 
 /*
    Copies all content from the src to the dst neural network but doesn't change
-   its architecture. The caller must ensure identical architectures.
+   its architecture. The caller must ensure identical architectures. Only the
+   parameters are copied if either of the networks is inference-only.
 */
 void mlp_copy(MLP *dst, MLP *src)
 {
+    matrix_copy(mlp_parameter_matrix(dst), mlp_parameter_matrix(src));
+    if (!dst->trainable || !src->trainable)
+        return;
+
+    matrix_copy(mlp_gradient_matrix(dst), mlp_gradient_matrix(src));
+
     for (int i = 0; i <= src->depth; i++)
     {
-        matrix_copy(dst->layers[i].weights, src->layers[i].weights);
-        matrix_copy(dst->layers[i].biases, src->layers[i].biases);
         matrix_copy(dst->layers[i].output, src->layers[i].output);
         matrix_copy(dst->layers[i].errors, src->layers[i].errors);
         matrix_copy(dst->layers[i].deltas, src->layers[i].deltas);
-        matrix_copy(dst->layers[i].gradWeights, src->layers[i].gradWeights);
-        matrix_copy(dst->layers[i].gradBiases, src->layers[i].gradBiases);
     }
     
     matrix_copy(dst->input, src->input);
     matrix_copy(dst->inputErrors, src->inputErrors);
-    matrix_copy(dst->output, src->output);
+}
+
+/* Copies only the weights and biases, which is a single pass over the parameter array. */
+void mlp_copy_params(MLP *dst, MLP *src)
+{
+    matrix_copy(mlp_parameter_matrix(dst), mlp_parameter_matrix(src));
+}
+
+/* Moves the weights and biases of dst towards those of src by the fraction tau. */
+void mlp_soft_update(MLP *dst, MLP *src, double tau)
+{
+    matrix_lerp(mlp_parameter_matrix(dst), mlp_parameter_matrix(src), tau);
 }
 
 /*
@@ -154,17 +309,119 @@ void mlp_copy(MLP *dst, MLP *src)
 */
 Matrix mlp_feedforward(MLP *mlp, Matrix x)
 {
-    matrix_transpose(x, mlp->input);
-    Matrix *input = &mlp->input;
+    /* Only the first x.rows rows of each buffer are used. The input is only kept for back-propagation. */
+    mlp->rows = x.rows;
+    Matrix input = x;
+    if (mlp->trainable)
+    {
+        input = matrix_rows(mlp->input, 0, x.rows);
+        matrix_copy(input, x);
+    }
+
     for (int i = 0; i <= mlp->depth; i++)
     {
-        matrix_dot(mlp->layers[i].weights, *input, mlp->layers[i].output);
-        matrix_add(mlp->layers[i].output, mlp->layers[i].biases);
-        matrix_apply(mlp->layers[i].output, mlp->layers[i].activation);
-        input = &mlp->layers[i].output;
+        /* output = input x weights^T + biases */
+        Matrix output = matrix_rows(mlp->layers[i].output, 0, x.rows);
+        matrix_gemm_add_apply(
+            input, 0, mlp->layers[i].weights, 1,
+            mlp->layers[i].biases, mlp->layers[i].activationCode,
+            output);
+        input = output;
     }
-    matrix_transpose(*input, mlp->output);
-    return mlp->output;
+    return input;
+}
+
+/*
+   Performs a feedforward operation on a single sample with matrix-vector products.
+   The values are stored in the first row of each buffer, exactly as if
+   mlp_feedforward was called with a batch of one sample.
+*/
+Matrix mlp_feedforward_single(MLP *mlp, Matrix x)
+{
+    mlp->rows = 1;
+    Matrix input = x;
+    if (mlp->trainable)
+    {
+        input = matrix_rows(mlp->input, 0, 1);
+        matrix_copy(input, x);
+    }
+
+    for (int i = 0; i <= mlp->depth; i++)
+    {
+        Matrix output = matrix_rows(mlp->layers[i].output, 0, 1);
+        matrix_gemv_add_apply(
+            input, mlp->layers[i].weights, mlp->layers[i].biases,
+            mlp->layers[i].activationCode, output);
+        input = output;
+    }
+    return input;
+}
+
+/* Returns the width of the widest layer of the neural network. */
+static int mlp_width(MLP *mlp)
+{
+    int width = 0;
+    for (int i = 0; i <= mlp->depth; i++)
+        if (mlp->layers[i].weights.rows > width)
+            width = mlp->layers[i].weights.rows;
+    return width;
+}
+
+/* Creates a feedforward workspace with two output buffers wide enough for any layer. */
+MLPContext *mlp_context_create(MLP *mlp, int batchSize)
+{
+    MLPContext *context = malloc(sizeof(MLPContext));
+    context->batchSize = batchSize;
+    context->width = mlp_width(mlp);
+    context->scratch = matrix_aligned_alloc(2 * batchSize * context->width);
+    return context;
+}
+
+void mlp_context_destroy(MLPContext *context)
+{
+    matrix_aligned_free(context->scratch);
+    free(context);
+}
+
+/* Returns the output buffer of the given layer within the context. */
+static Matrix mlp_context_output(MLP *mlp, MLPContext *context, int layer, int rows)
+{
+    Scalar *buffer = context->scratch + (layer % 2) * context->batchSize * context->width;
+    return (Matrix){ rows, mlp->layers[layer].weights.rows, buffer };
+}
+
+/*
+   Performs a feedforward operation that only reads the neural network. The layer
+   outputs are written to the context, so that several threads can evaluate the
+   same network at once.
+*/
+Matrix mlp_context_feedforward(MLP *mlp, MLPContext *context, Matrix x)
+{
+    Matrix input = x;
+    for (int i = 0; i <= mlp->depth; i++)
+    {
+        Matrix output = mlp_context_output(mlp, context, i, x.rows);
+        matrix_gemm_add_apply(
+            input, 0, mlp->layers[i].weights, 1,
+            mlp->layers[i].biases, mlp->layers[i].activationCode,
+            output);
+        input = output;
+    }
+    return input;
+}
+
+Matrix mlp_context_feedforward_single(MLP *mlp, MLPContext *context, Matrix x)
+{
+    Matrix input = x;
+    for (int i = 0; i <= mlp->depth; i++)
+    {
+        Matrix output = mlp_context_output(mlp, context, i, 1);
+        matrix_gemv_add_apply(
+            input, mlp->layers[i].weights, mlp->layers[i].biases,
+            mlp->layers[i].activationCode, output);
+        input = output;
+    }
+    return input;
 }
 
 /*
@@ -173,41 +430,75 @@ Matrix mlp_feedforward(MLP *mlp, Matrix x)
    over all samples is returned.
 */
 double mlp_backpropagate(MLP *mlp, Matrix y, int lossFunctionCode)
-{   
+{
+    return mlp_backpropagate_flags(mlp, y, lossFunctionCode, BACKPROP_ALL, 0, 0);
+}
+
+double mlp_backpropagate_flags(MLP *mlp, Matrix y, int lossFunctionCode, int flags, int column, int columns)
+{
+    /* Work on the rows that were used by the last feedforward call. */
+    int rows = mlp->rows;
+    Layer *last = &mlp->layers[mlp->depth];
+    Matrix output = matrix_rows(last->output, 0, rows);
+    Matrix errors = matrix_rows(last->errors, 0, rows);
+    Matrix deltas = matrix_rows(last->deltas, 0, rows);
+
     /* Use the loss function to compute the error values. */
     LossFunction lossFunction = getLossFunction(lossFunctionCode);
-    double loss = lossFunction(mlp->output, y, mlp->layers[mlp->depth].errors);
+    double loss = lossFunction(output, matrix_rows(y, 0, rows), errors);
 
     /* Compute the deltas of the last layer. */
-    matrix_copy(mlp->layers[mlp->depth].deltas, mlp->output);
-    matrix_apply(mlp->layers[mlp->depth].deltas, mlp->layers[mlp->depth].activationDeriv);
+    matrix_copy(deltas, output);
+    matrix_apply(deltas, last->activationDeriv);
     
     /* Compute the error of the previous layer. */
     if (mlp->depth > 0)
-        matrix_odot(mlp->layers[mlp->depth].deltas, mlp->layers[mlp->depth].errors);
+        matrix_odot(deltas, errors);
 
     /* Propagate the deltas towards the first layer. */
     for (int i = mlp->depth - 1; i >= 0; i--)
     {
-        matrix_dot(mlp->layers[i+1].deltas, mlp->layers[i+1].weights, mlp->layers[i].errors);
-        matrix_transpose(mlp->layers[i].output, mlp->layers[i].deltas);
-        matrix_apply(mlp->layers[i].deltas, mlp->layers[i].activationDeriv);
-        matrix_odot(mlp->layers[i].deltas, mlp->layers[i].errors);
+        Matrix nextDeltas = deltas;
+        errors = matrix_rows(mlp->layers[i].errors, 0, rows);
+        deltas = matrix_rows(mlp->layers[i].deltas, 0, rows);
+
+        matrix_dot(nextDeltas, mlp->layers[i+1].weights, errors);
+        matrix_copy(deltas, matrix_rows(mlp->layers[i].output, 0, rows));
+        matrix_apply(deltas, mlp->layers[i].activationDeriv);
+        matrix_odot(deltas, errors);
+    }
+
+    /* Compute the input errors, only for the requested columns. */
+    if (flags & BACKPROP_INPUT)
+    {
+        Matrix weights = mlp->layers[0].weights;
+        if (columns <= 0)
+        {
+            column = 0;
+            columns = weights.columns;
+        }
+
+        gemm(rows, columns, weights.rows,
+            deltas.data, deltas.columns, 1,
+            weights.data + column, weights.columns, 1,
+            mlp->inputErrors.data + column, mlp->inputErrors.columns, 1, NULL);
     }
 
-    /* Compute the input errors. */
-    matrix_dot(mlp->layers[0].deltas, mlp->layers[0].weights, mlp->inputErrors);
+    if (!(flags & BACKPROP_PARAMETERS))
+        return loss;
 
     /* Compute the gradients. */
-    Matrix *input = &mlp->input;
+    Matrix input = matrix_rows(mlp->input, 0, rows);
     for (int i = 0; i <= mlp->depth; i++)
     {
-        matrix_dot_transpose(*input, mlp->layers[i].deltas, mlp->layers[i].gradWeights);
-        matrix_divide(mlp->layers[i].gradWeights, (double)mlp->batchSize);
-        input = &mlp->layers[i].output;
+        deltas = matrix_rows(mlp->layers[i].deltas, 0, rows);
+
+        matrix_gemm(deltas, 1, input, 0, mlp->layers[i].gradWeights);
+        matrix_divide(mlp->layers[i].gradWeights, (double)rows);
+        input = matrix_rows(mlp->layers[i].output, 0, rows);
 
-        matrix_sum_rows_transpose(mlp->layers[i].deltas, mlp->layers[i].gradBiases);
-        matrix_divide(mlp->layers[i].gradBiases, (double)mlp->batchSize);
+        matrix_sum_rows(deltas, mlp->layers[i].gradBiases);
+        matrix_divide(mlp->layers[i].gradBiases, (double)rows);
     }
 
     return loss;
@@ -219,7 +510,7 @@ double mlp_backpropagate(MLP *mlp, Matrix y, int lossFunctionCode)
 */
 Matrix mlp_get_input_errors(MLP *mlp)
 {
-    return mlp->inputErrors;
+    return matrix_rows(mlp->inputErrors, 0, mlp->rows);
 }
 
 /* 
@@ -228,14 +519,9 @@ Matrix mlp_get_input_errors(MLP *mlp)
 */
 void mlp_sgd(MLP *mlp, double lr)
 {
-    for (int i = 0; i <= mlp->depth; i++)
-    {
-        matrix_multiply(mlp->layers[i].gradWeights, lr);
-        matrix_subtract(mlp->layers[i].weights, mlp->layers[i].gradWeights);
-
-        matrix_multiply(mlp->layers[i].gradBiases, lr);
-        matrix_subtract(mlp->layers[i].biases, mlp->layers[i].gradBiases);
-    }
+    Matrix gradients = mlp_gradient_matrix(mlp);
+    matrix_multiply(gradients, lr);
+    matrix_subtract(mlp_parameter_matrix(mlp), gradients);
 }
 
 void mlp_clip_gradients(Matrix gradients, double clipnorm)
@@ -252,14 +538,9 @@ void mlp_clip_gradients(Matrix gradients, double clipnorm)
 void mlp_sgd_clip(MLP *mlp, double lr, double clipnorm)
 {
     for (int i = 0; i <= mlp->depth; i++)
-    {
         mlp_clip_gradients(mlp->layers[i].gradWeights, clipnorm);
-        matrix_multiply(mlp->layers[i].gradWeights, lr);
-        matrix_subtract(mlp->layers[i].weights, mlp->layers[i].gradWeights);
 
-        matrix_multiply(mlp->layers[i].gradBiases, lr);
-        matrix_subtract(mlp->layers[i].biases, mlp->layers[i].gradBiases);
-    }
+    mlp_sgd(mlp, lr);
 }
 
 int mlp_load_weights(MLP *mlp, const char *filename)
@@ -274,7 +555,12 @@ int mlp_load_weights(MLP *mlp, const char *filename)
     return result;
 }
 
-int mlp_read_weights(MLP *mlp, FILE *file)
+/*
+   Reads the weights in the format used before the parameters were stored in a single
+   array, where the weights and biases of each layer are stored as separate matrices.
+   The first integer of the stream has already been read and is given as the tag.
+*/
+static int mlp_read_weights_legacy(MLP *mlp, int tag, FILE *file)
 {
     int rows, columns;
     Matrix matrix;
@@ -284,27 +570,148 @@ int mlp_read_weights(MLP *mlp, FILE *file)
         rows = mlp->layers[i].weights.rows;
         columns = mlp->layers[i].weights.columns;
         
-        matrix = matrix_read(file);
+        matrix = i == 0 ? matrix_read_tagged(tag, file) : matrix_read(file);
         if (matrix.rows != rows || matrix.columns != columns || matrix.data == NULL)
             return -1;
         
         matrix_copy(mlp->layers[i].weights, matrix);
         matrix_destroy(matrix);
 
-        rows = mlp->layers[i].biases.rows;
         columns = mlp->layers[i].biases.columns;
 
         matrix = matrix_read(file);
-        if (matrix.rows != rows || matrix.columns != columns || matrix.data == NULL)
+        if (matrix.data == NULL)
             return -1;
-        
-        matrix_copy(mlp->layers[i].biases, matrix);
+
+        if (matrix.rows == 1 && matrix.columns == columns)
+            matrix_copy(mlp->layers[i].biases, matrix);
+        else if (matrix.rows == columns)
+        {
+            /* Older files store the biases in a column, repeated for each sample in the batch. */
+            for (int j = 0; j < columns; j++)
+                mlp->layers[i].biases.data[j] = MATRIX(matrix, j, 0);
+        }
+        else
+        {
+            matrix_destroy(matrix);
+            return -1;
+        }
+
         matrix_destroy(matrix);
     }
 
     return 0;
 }
 
+/*
+   Reads the header of a weight stream that follows the tag. On success, the layer sizes
+   and the activation codes are returned in newly allocated arrays.
+*/
+static int mlp_read_header(FILE *file, int *precision, int *depth, int **sizes, int **activations, int *count)
+{
+    if (fread(precision, sizeof(int), 1, file) != 1 || fread(depth, sizeof(int), 1, file) != 1)
+        return -1;
+    if ((*precision != -(int)sizeof(double) && *precision != -(int)sizeof(float)) || *depth < 0)
+        return -1;
+
+    *sizes = malloc((*depth + 2) * sizeof(int));
+    *activations = malloc((*depth + 1) * sizeof(int));
+
+    if (fread(*sizes, sizeof(int), *depth + 2, file) != *depth + 2
+        || fread(*activations, sizeof(int), *depth + 1, file) != *depth + 1
+        || fread(count, sizeof(int), 1, file) != 1)
+    {
+        free(*sizes);
+        free(*activations);
+        return -1;
+    }
+
+    for (int i = 0; i < *depth + 2; i++)
+    {
+        if ((*sizes)[i] <= 0)
+        {
+            free(*sizes);
+            free(*activations);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int mlp_read_weights(MLP *mlp, FILE *file)
+{
+    int tag;
+    if (fread(&tag, sizeof(int), 1, file) != 1)
+        return -1;
+
+    if (tag != MLP_FILE_TAG)
+        return mlp_read_weights_legacy(mlp, tag, file);
+
+    /* The header: precision, depth, layer sizes, activation codes and the parameter count. */
+    int precision, depth, count;
+    int *sizes, *activations;
+    if (mlp_read_header(file, &precision, &depth, &sizes, &activations, &count) != 0)
+        return -1;
+
+    int *expectedSizes = malloc((mlp->depth + 2) * sizeof(int));
+    int *expectedActivations = malloc((mlp->depth + 1) * sizeof(int));
+    mlp_get_architecture(mlp, expectedSizes, expectedActivations);
+
+    int result = depth == mlp->depth && count == mlp->parameterCount ? 0 : -1;
+    for (int i = 0; result == 0 && i <= depth; i++)
+        if (sizes[i] != expectedSizes[i] || activations[i] != expectedActivations[i])
+            result = -1;
+    if (result == 0 && sizes[depth + 1] != expectedSizes[depth + 1])
+        result = -1;
+
+    free(sizes);
+    free(activations);
+    free(expectedSizes);
+    free(expectedActivations);
+
+    if (result != 0)
+        return -1;
+
+    return matrix_read_elements(mlp->parameters, count, -precision, file);
+}
+
+MLP *mlp_load_inference(const char *filename, int batchSize)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return NULL;
+
+    MLP *mlp = mlp_read_inference(file, batchSize);
+    fclose(file);
+
+    return mlp;
+}
+
+MLP *mlp_read_inference(FILE *file, int batchSize)
+{
+    int tag;
+    if (fread(&tag, sizeof(int), 1, file) != 1 || tag != MLP_FILE_TAG)
+        return NULL;
+
+    int precision, depth, count;
+    int *sizes, *activations;
+    if (mlp_read_header(file, &precision, &depth, &sizes, &activations, &count) != 0)
+        return NULL;
+
+    MLP *mlp = mlp_allocate(depth, sizes, activations, batchSize, 0);
+    free(sizes);
+    free(activations);
+
+    if (count != mlp->parameterCount || matrix_read_elements(mlp->parameters, count, -precision, file) != 0)
+    {
+        mlp_destroy(mlp);
+        return NULL;
+    }
+
+    return mlp;
+}
+
 int mlp_save_weights(MLP *mlp, const char *filename)
 {
     FILE *file = fopen(filename, "wb");
@@ -319,14 +726,29 @@ int mlp_save_weights(MLP *mlp, const char *filename)
 
 int mlp_write_weights(MLP *mlp, FILE *file)
 {
-    for (int i = 0; i <= mlp->depth; i++)
-    {
-        if (matrix_write(mlp->layers[i].weights, file) != 0)
-            return -1;
+    int header[3] = { MLP_FILE_TAG, -(int)sizeof(Scalar), mlp->depth };
+    if (fwrite(header, sizeof(int), 3, file) != 3)
+        return -1;
 
-        if (matrix_write(mlp->layers[i].biases, file) != 0)
-            return -1;
-    }
+    int *sizes = malloc((mlp->depth + 2) * sizeof(int));
+    int *activations = malloc((mlp->depth + 1) * sizeof(int));
+    mlp_get_architecture(mlp, sizes, activations);
+
+    int result = 0;
+    if (fwrite(sizes, sizeof(int), mlp->depth + 2, file) != mlp->depth + 2
+        || fwrite(activations, sizeof(int), mlp->depth + 1, file) != mlp->depth + 1
+        || fwrite(&mlp->parameterCount, sizeof(int), 1, file) != 1)
+        result = -1;
+
+    free(sizes);
+    free(activations);
+
+    if (result != 0)
+        return -1;
+
+    /* All the weights and biases are written at once. */
+    if (fwrite(mlp->parameters, sizeof(Scalar), mlp->parameterCount, file) != mlp->parameterCount)
+        return -1;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -14,26 +14,71 @@
  * This also means a fixed batch size. This enables all the needed matrices
  * to be created initially, without any need for additional memory allocations
  * during MLP processing.
+ *
+ * All the weights and biases of a MLP are stored in a single aligned array,
+ * layer by layer, and their gradients in another array with the same layout.
+ * The weight and bias matrices of the layers are views into these arrays, so
+ * operations on the whole model, such as copying or an optimization step, are
+ * single passes over one array.
+ *
+ * A MLP can also be created for inference only. Such a MLP has no gradients
+ * and no buffers for the back-propagation, and all its layers write their
+ * outputs into two shared scratch buffers, so it takes little more memory
+ * than its parameters. It can only be used with the feedforward operations.
+ *
+ * The feedforward operations store the layer outputs within the MLP, so one
+ * MLP must not be evaluated by several threads at once. To share one copy of
+ * the parameters among many threads, each thread creates its own `MLPContext`
+ * and passes it to `mlp_context_feedforward`, which only reads the MLP.
  */
 
 #include <stdio.h>
 #include "matrix.h"
 
+/**
+ * The tag at the start of the weight files, which distinguishes them from the
+ * files written by older versions of the library.
+ */
+#define MLP_FILE_TAG 0x57504C4D
+
+/**
+ * Back-propagation flag: compute the gradients of the weights and biases.
+ */
+#define BACKPROP_PARAMETERS 1
+
+/**
+ * Back-propagation flag: compute the errors at the input layer.
+ */
+#define BACKPROP_INPUT      2
+
+/**
+ * Back-propagation flags: compute both the gradients and the input errors.
+ */
+#define BACKPROP_ALL        3
+
+/**
+ * A task run by `mlp_run_parallel`. It is called once for each `index` from 0
+ * to `count - 1`, with the same `arg` pointer.
+ */
+typedef void (*MLPTask)(void *arg, int index, int count);
+
 /**
  * Definition of a layer within a MLP.
  */
 typedef struct Layer
 {
     /**
-     * Stores the weights between this and the previous layer.
+     * Stores the weights between this and the previous layer. This is a view
+     * into the `parameters` array of the MLP.
      * Format: (output size / neurons × input size / neurons on previous layer).
      */
     Matrix weights;
 
     /**
-     * Stores the bias for each neuron in a column. For easier computation, the
-     * column is repeated horizontally for each sample in the batch.
-     * Format: (output size / neurons × batch size)
+     * Stores the bias for each neuron in a single row. The row is added to the
+     * output of every sample in the batch. This is a view into the
+     * `parameters` array of the MLP.
+     * Format: (1 × output size / neurons)
      */
     Matrix biases;
 
@@ -41,7 +86,7 @@ typedef struct Layer
      * Stores the layer's output values (after activation). These values are
      * computed by the feedforward method and later used by the back-propagation
      * method, if called.
-     * Format (output size / neurons × batch size)
+     * Format: (batch size × output size / neurons)
      */
     Matrix output;
 
@@ -61,17 +106,23 @@ typedef struct Layer
 
     /**
      * Weight gradients computed during back-propagation, based on the deltas.
+     * This is a view into the `gradients` array of the MLP.
      * Format: (output size / neurons × input size / neurons on previous layer)
      */
     Matrix gradWeights;
 
     /**
      * Bias gradients computed during back-propagation, based on the deltas.
-     * The column is repeated for each sample in the batch.
-     * Format: (output size / neurons × batch size)
+     * This is a view into the `gradients` array of the MLP.
+     * Format: (1 × output size / neurons)
      */
     Matrix gradBiases;
 
+    /**
+     * The integer code of the activation function used on this layer.
+     */
+    int activationCode;
+
     /**
      * The activation function that is applied during feedforward to the output
      * of every neuron on this layer.
@@ -96,12 +147,27 @@ typedef struct MLP
     int depth;
 
     /**
-     * The number of samples within a batch. This value is constant and a
-     * batch of this size must always be provided to the feedforward and the
-     * back-propagation operations.
+     * The maximum number of samples within a batch. All the buffers are
+     * allocated for this many samples, but a batch of any size up to this
+     * value can be provided to the feedforward and the back-propagation
+     * operations.
      */
     int batchSize;
 
+    /**
+     * Set to 1 if the MLP can be trained, or to 0 if it was created for
+     * inference only. An inference-only MLP has no `gradients`, and its
+     * `input`, `inputErrors` and the `errors`, `deltas`, `gradWeights` and
+     * `gradBiases` matrices of its layers are empty (0 × 0).
+     */
+    int trainable;
+
+    /**
+     * The number of samples in the batch given to the last feedforward call.
+     * Only this many rows of the per-layer buffers are in use.
+     */
+    int rows;
+
     /**
      * The array of layers, which starts with the first hidden layer and ends
      * with the output layer at index `depth`.
@@ -110,10 +176,8 @@ typedef struct MLP
 
     /**
      * Because the input layer is not stored within the MLP structure, the
-     * `input` matrix stores the input values. To comply with the matrix
-     * operations between the MLP layer, this matrix is the transposed matrix
-     * of the actual input.
-     * Format: (input size / neurons × batch size)
+     * `input` matrix stores the input values.
+     * Format: (batch size × input size / neurons)
      */
     Matrix input;
 
@@ -128,18 +192,120 @@ typedef struct MLP
     Matrix inputErrors;
 
     /**
-     * The output of the last layer, but transposed to match the format of the
-     * input batch. This matrix is returned by the `feedforward` function.
+     * The total number of weights and biases.
+     */
+    int parameterCount;
+
+    /**
+     * All the weights and biases. For each layer, the weights are stored first
+     * (row by row), followed by the biases.
+     */
+    Scalar *parameters;
+
+    /**
+     * The gradients of all the weights and biases, in the same layout as the
+     * `parameters`.
+     */
+    Scalar *gradients;
+
+    /**
+     * The two buffers that hold the layer outputs of an inference-only MLP.
+     * The layers use them in turns, so each layer reads the output of the
+     * previous layer from one buffer and writes its own output to the other.
+     * NULL for trainable MLPs, whose layers have their own output buffers.
+     */
+    Scalar *scratch;
+
+    /**
+     * The output of the last layer. It shares its data with the `output`
+     * matrix of the last layer and is returned by the `feedforward` function.
+     * Format: (batch size × output size / neurons)
      */
     Matrix output;
 } MLP;
 
+/**
+ * The workspace of a feedforward operation that is separate from the MLP. A
+ * context holds the layer outputs, so any number of threads can evaluate the
+ * same MLP at once, each with its own context, without any locking. The
+ * parameters of the MLP must not be changed while it is being evaluated.
+ */
+typedef struct MLPContext
+{
+    /**
+     * The maximum number of samples that can be evaluated at once.
+     */
+    int batchSize;
+
+    /**
+     * The width of the widest layer of the MLP the context was created for.
+     */
+    int width;
+
+    /**
+     * The two buffers (batch size × width) that the layers use in turns for
+     * their outputs.
+     */
+    Scalar *scratch;
+} MLPContext;
+
 /**
  * Initializes the MLPC library. This function should be called once at the
- * start of the program.
+ * start of the program. It seeds the random number generator and selects the
+ * fastest kernels that the running CPU supports.
  */
 void mlp_init();
 
+/**
+ * Forces the library to use the kernels for the given instruction set, which
+ * is one of the `SIMD_*` codes defined in simd.h. This is useful for comparing
+ * the performance of different kernels on the same machine. `SIMD_AUTO`
+ * restores the automatic selection done by `mlp_init`. If the running CPU
+ * does not support the requested instruction set, the best supported lower
+ * one is used.
+ *
+ * \returns The code of the instruction set that is actually used.
+ */
+int mlp_set_simd_level(int level);
+
+/**
+ * \returns The code of the instruction set whose kernels are currently used.
+ */
+int mlp_get_simd_level();
+
+/**
+ * Initializes the MLPC library like `mlp_init` and additionally starts a pool
+ * of worker threads, which is used to split large matrix products across
+ * processor cores. The `threads` count includes the calling thread. A value of
+ * 0 or less uses one thread for each core, and a value of 1 runs everything on
+ * the calling thread, which is also what `mlp_init` does. Small products are
+ * always computed on the calling thread.
+ *
+ * \returns The number of threads actually used.
+ */
+int mlp_init_threads(int threads);
+
+/**
+ * Checks whether the feedforward and the back-propagation of the given `mlp`
+ * on a batch of `batchSize` samples split any of their matrix products among
+ * the threads of the worker pool (see `mlp_init_threads`). If they do not, the
+ * MLP keeps only one thread busy, and other work can be done on the remaining
+ * threads of the pool at the same time.
+ *
+ * \returns 1 if some of the products are split, 0 otherwise.
+ */
+int mlp_is_parallel(MLP *mlp, int batchSize);
+
+/**
+ * Executes `count` independent tasks on the threads of the worker pool (see
+ * `mlp_init_threads`) and waits until all of them are done. The pool runs one
+ * operation at a time, so if this function is called from within a task, or
+ * while another thread is using the pool, the tasks are executed one after
+ * another on the calling thread. The same happens if the pool has a single
+ * thread. The tasks must therefore not depend on running at the same time.
+ */
+void mlp_run_parallel(MLPTask task, void *arg, int count);
+
 /**
  * Creates a MLP on the heap. A MLP created with this function must eventually
  * be destroyed by calling `mlp_destroy`.
@@ -158,7 +324,7 @@ void mlp_init();
  * \param outputLayerActivation
  * The code of the activation function to be used on the output layer.
  * \param batchSize
- * The number of samples that this MLP processes at once.
+ * The maximum number of samples that this MLP processes at once.
  * 
  * \returns The newly created and initialized MLP structure.
  */
@@ -171,15 +337,43 @@ MLP *mlp_create(
     int outputLayerActivation,
     int batchSize);
 
+/**
+ * Creates a new MLP for inference only. The parameters are the same as those
+ * of `mlp_create`. The MLP does not allocate any of the buffers that are used
+ * by the back-propagation, so it can only be used with `mlp_feedforward` and
+ * `mlp_feedforward_single`, and as the source or the destination of the
+ * parameter copies. Every MLP created with this function must eventually be
+ * destroyed by calling `mlp_destroy`.
+ *
+ * \returns The newly created and initialized MLP structure.
+ */
+MLP *mlp_create_inference(
+    int inputSize,
+    int outputSize,
+    int depth,
+    int *hiddenLayerSizes,
+    int hiddenLayerActivation,
+    int outputLayerActivation,
+    int batchSize);
+
 /**
  * Creates a new MLP that is a clone of the given MLP. All the content from the
  * given MLP is copied to the newly created MLP. A MLP created using this
- * function must eventually be destroyed by calling `mlp_destroy`.
+ * function must eventually be destroyed by calling `mlp_destroy`. The clone of
+ * an inference-only MLP is also inference-only.
  * 
  * \returns The newly created and initialized MLP structure.
  */
 MLP *mlp_clone(MLP *mlp);
 
+/**
+ * Creates an inference-only MLP (see `mlp_create_inference`) with the same
+ * architecture, batch size and parameters as the given MLP.
+ *
+ * \returns The newly created MLP structure.
+ */
+MLP *mlp_clone_inference(MLP *mlp);
+
 /**
  * Frees the memory allocated on the heap by the given MLP. After being
  * destroyed, the MLP structure should not be used anymore.
@@ -198,43 +392,131 @@ void mlp_initialize(MLP *mlp);
 /**
  * Copies all the contents from the `src` MLP to the `dst` MLP. Both MLPs must
  * be of identical architecture. It is easiest and safest to use this function
- * on MLP clones.
+ * on MLP clones. If either of the MLPs is inference-only, only the parameters
+ * are copied.
  */
 void mlp_copy(MLP *dst, MLP *src);
 
+/**
+ * Copies only the weights and biases from the `src` MLP to the `dst` MLP. The
+ * buffers used by the feedforward and back-propagation operations are left
+ * unchanged. Both MLPs must be of identical architecture.
+ */
+void mlp_copy_params(MLP *dst, MLP *src);
+
+/**
+ * Moves the weights and biases of the `dst` MLP towards those of the `src` MLP
+ * (Polyak averaging). Both MLPs must be of identical architecture. Each
+ * parameter is updated as follows:
+ *
+ *     dst = tau * src + (1 - tau) * dst
+ *
+ * With `tau` equal to 1, this is the same as `mlp_copy_params`.
+ */
+void mlp_soft_update(MLP *dst, MLP *src, double tau);
+
 /**
  * Performs the feedforward operation on the given batch `x`. The shape of
- * matrix `x` must conform to the input shape of the MLP (batch size × 
- * input size).
+ * matrix `x` must conform to the input shape of the MLP (samples × input
+ * size), where the number of samples can be anything from 1 to the batch
+ * size. The work done is proportional to the number of samples.
  *
  * The outputs are computed as follows:
  * 
- *     output[i] = activation(weights[i] x output[i-1] + biases[i])
+ *     output[i] = activation(output[i-1] x weights[i]^T + biases[i])
  * 
  * \returns The predicted `y` values. The returned matrix must not be destroyed
  * by the caller.
  */
 Matrix mlp_feedforward(MLP *mlp, Matrix x);
 
+/**
+ * Performs the feedforward operation on a single sample `x` (1 × input size).
+ * The result is the same as that of `mlp_feedforward` with a batch of one
+ * sample, including the values stored for back-propagation, but each layer is
+ * computed with a matrix-vector product instead of the blocked GEMM. This is
+ * the fastest way to evaluate one sample, e.g., within a control loop.
+ *
+ * \returns The predicted `y` values (1 × output size). The returned matrix
+ * must not be destroyed by the caller.
+ */
+Matrix mlp_feedforward_single(MLP *mlp, Matrix x);
+
+/**
+ * Creates a feedforward workspace for the given `mlp` that can evaluate up to
+ * `batchSize` samples at once. The context can also be used with any other
+ * MLP whose layers are not wider than those of `mlp`. Every context created
+ * with this function must eventually be destroyed by calling
+ * `mlp_context_destroy`.
+ *
+ * \returns The newly created context.
+ */
+MLPContext *mlp_context_create(MLP *mlp, int batchSize);
+
+/**
+ * Frees the memory allocated by the given context.
+ */
+void mlp_context_destroy(MLPContext *context);
+
+/**
+ * Performs the feedforward operation on the given batch `x` like
+ * `mlp_feedforward`, but stores the layer outputs within the given `context`
+ * instead of the MLP. The MLP is only read, so several threads can evaluate
+ * the same MLP at once, as long as each of them uses its own context. The
+ * number of samples must not exceed the batch size of the context.
+ *
+ * \returns The predicted `y` values. The returned matrix is valid until the
+ * next use of the context and must not be destroyed by the caller.
+ */
+Matrix mlp_context_feedforward(MLP *mlp, MLPContext *context, Matrix x);
+
+/**
+ * Performs the feedforward operation on a single sample `x` like
+ * `mlp_feedforward_single`, but with the given `context` (see
+ * `mlp_context_feedforward`).
+ *
+ * \returns The predicted `y` values (1 × output size). The returned matrix is
+ * valid until the next use of the context and must not be destroyed by the
+ * caller.
+ */
+Matrix mlp_context_feedforward_single(MLP *mlp, MLPContext *context, Matrix x);
+
 /**
  * Performs the back-propagation operation using the errors obtained from the
  * given true values `y` and the loss function given with the integer code
  * `lossFunctionCode`. The predicted outputs are stored internally after
  * the last feedforward call. The function computes the error values and the
  * delta values (local gradient) as well as the weight and bias gradients
- * on each layer.
+ * on each layer. The MLP must not be inference-only.
  * 
  * The values are computed as follows:
  * 
- *     deltas[depth] = activationDeriv(error) * activationDeriv(output[i])^T
- *     deltas[i] = (deltas[i+1] x weights[i+1]) * activationDeriv(output[i])^T
- *     gradWeights = (1/batch size) * (output[i-1] x deltas[i])^T  
- *     gradBiases = (1/batch size) * ([1,1,...,1] x deltas[i]))^T x [1,1,...,1]
+ *     deltas[depth] = activationDeriv(error) * activationDeriv(output[i])
+ *     deltas[i] = (deltas[i+1] x weights[i+1]) * activationDeriv(output[i])
+ *     gradWeights = (1/batch size) * deltas[i]^T x output[i-1]
+ *     gradBiases = (1/batch size) * [1,1,...,1] x deltas[i]
  * 
  * \returns The mean error computed by the loss function.
  */
 double mlp_backpropagate(MLP *mlp, Matrix y, int lossFunctionCode);
 
+/**
+ * Performs the back-propagation like `mlp_backpropagate`, but computes only
+ * what is requested by the `flags`, a combination of `BACKPROP_PARAMETERS` and
+ * `BACKPROP_INPUT`. Without `BACKPROP_PARAMETERS` the weight and bias gradients
+ * are left unchanged, which is useful when a MLP only passes the errors on to
+ * another MLP. Without `BACKPROP_INPUT` the input errors are not computed,
+ * which saves one matrix product in supervised training.
+ *
+ * The input errors can further be limited to the input columns from `column`
+ * to `column + columns - 1`. Only these columns of the matrix returned by
+ * `mlp_get_input_errors` are then valid. If `columns` is 0 or less, the errors
+ * of all the inputs are computed.
+ *
+ * \returns The mean error computed by the loss function.
+ */
+double mlp_backpropagate_flags(MLP *mlp, Matrix y, int lossFunctionCode, int flags, int column, int columns);
+
 /**
  * Returns the error values at the input level. This is useful when performing
  * back-propagation throughout multiple connected neural networks.
@@ -269,12 +551,34 @@ void mlp_sgd_clip(MLP *mlp, double lr, double clipnorm);
 int mlp_load_weights(MLP *mlp, const char *filename);
 
 /**
- * Loads weights and biases from a binary stream.
+ * Loads weights and biases from a binary stream. The architecture stored in
+ * the stream must match that of the `mlp`. Streams written by older versions
+ * of the library, which stored each weight and bias matrix separately, are
+ * also accepted.
  * 
  * \returns 0 if successful, -1 otherwise.
  */
 int mlp_read_weights(MLP *mlp, FILE *file);
 
+/**
+ * Creates an inference-only MLP (see `mlp_create_inference`) with the
+ * architecture and the parameters stored in the given weight file. The MLP
+ * can process up to `batchSize` samples at once. Only files written by
+ * `mlp_save_weights` are accepted, because the files written by older
+ * versions of the library do not store the architecture.
+ *
+ * \returns The loaded MLP, or NULL if the file could not be read.
+ */
+MLP *mlp_load_inference(const char *filename, int batchSize);
+
+/**
+ * Creates an inference-only MLP from a binary stream written by
+ * `mlp_write_weights`, like `mlp_load_inference`.
+ *
+ * \returns The loaded MLP, or NULL if the stream could not be read.
+ */
+MLP *mlp_read_inference(FILE *file, int batchSize);
+
 /**
  * Saves weights and biases to a file.
  * 
@@ -283,7 +587,11 @@ int mlp_read_weights(MLP *mlp, FILE *file);
 int mlp_save_weights(MLP *mlp, const char *filename);
 
 /**
- * Saves weights and biases to a binary stream.
+ * Saves weights and biases to a binary stream. The stream starts with a
+ * header that contains `MLP_FILE_TAG`, the precision (the negated size of a
+ * Scalar), the depth, the layer sizes from the input to the output layer, the
+ * activation codes and the number of parameters. It is followed by the
+ * `parameters` array.
  * 
  * \returns 0 if successful, -1 otherwise.
  */
@@ -0,0 +1,415 @@
+#include <malloc.h>
+#include <math.h>
+#include "qmlp.h"
+#include "simd.h"
+#include "gemm.h"
+
+/* Identifies the quantized MLP files ("QMLP"). */
+#define QMLP_FILE_TAG 0x504C4D51
+
+/* The bytes of weights that are multiplied with the whole batch at once, so that they stay in the L1 cache. */
+#define QMLP_BLOCK 16384
+
+/* A helper function that allocates a QMLP with the given layer sizes. */
+static QMLP *qmlp_allocate(int depth, int batchSize, int *sizes)
+{
+    QMLP *qmlp = malloc(sizeof(QMLP));
+    qmlp->depth = depth;
+    qmlp->batchSize = batchSize;
+    qmlp->layers = malloc((depth + 1) * sizeof(QLayer));
+
+    int maxSize = sizes[0];
+    int maxStride = 0;
+    for (int i = 0; i <= depth; i++)
+    {
+        QLayer *layer = &qmlp->layers[i];
+        layer->inputSize = sizes[i];
+        layer->outputSize = sizes[i + 1];
+        layer->stride = (sizes[i] + SIMD_INT8_BLOCK - 1) / SIMD_INT8_BLOCK * SIMD_INT8_BLOCK;
+        layer->weights = calloc(layer->outputSize * layer->stride, sizeof(int8_t));
+        layer->scales = malloc(layer->outputSize * sizeof(float));
+        layer->rowSums = malloc(layer->outputSize * sizeof(int32_t));
+        layer->biases = malloc(layer->outputSize * sizeof(Scalar));
+
+        if (sizes[i + 1] > maxSize)
+            maxSize = sizes[i + 1];
+        if (layer->stride > maxStride)
+            maxStride = layer->stride;
+    }
+
+    qmlp->quantized = malloc(batchSize * maxStride * sizeof(uint8_t));
+    qmlp->products = malloc(batchSize * maxSize * sizeof(int32_t));
+    qmlp->activations[0] = malloc(batchSize * maxSize * sizeof(Scalar));
+    qmlp->activations[1] = malloc(batchSize * maxSize * sizeof(Scalar));
+    qmlp->output = matrix_create(batchSize, sizes[depth + 1]);
+
+    return qmlp;
+}
+
+/* Computes the sums of the quantized weight rows. */
+static void qmlp_compute_row_sums(QLayer *layer)
+{
+    for (int row = 0; row < layer->outputSize; row++)
+    {
+        int8_t *w = layer->weights + row * layer->stride;
+        layer->rowSums[row] = 0;
+        for (int col = 0; col < layer->inputSize; col++)
+            layer->rowSums[row] += w[col];
+    }
+}
+
+/*
+   Runs the samples through the original MLP one at a time, using its weights
+   directly, and records the largest absolute input of each layer.
+*/
+static void qmlp_calibrate(QMLP *qmlp, MLP *mlp, Matrix samples)
+{
+    for (int i = 0; i <= qmlp->depth; i++)
+        qmlp->layers[i].inputScale = 0;
+
+    for (int s = 0; s < samples.rows; s++)
+    {
+        Scalar *input = samples.data + s * samples.columns;
+        for (int i = 0; i <= mlp->depth; i++)
+        {
+            Layer *layer = &mlp->layers[i];
+            QLayer *qlayer = &qmlp->layers[i];
+            Scalar *output = qmlp->activations[i % 2];
+
+            for (int col = 0; col < qlayer->inputSize; col++)
+                if (fabs(input[col]) > qlayer->inputScale)
+                    qlayer->inputScale = (float)fabs(input[col]);
+
+            for (int row = 0; row < qlayer->outputSize; row++)
+            {
+                Scalar *w = layer->weights.data + row * layer->weights.columns;
+                double sum = layer->biases.data[row];
+                for (int col = 0; col < qlayer->inputSize; col++)
+                    sum += w[col] * input[col];
+                output[row] = layer->activation((Scalar)sum);
+            }
+
+            input = output;
+        }
+    }
+
+    /* The largest absolute input maps to 127. */
+    for (int i = 0; i <= qmlp->depth; i++)
+    {
+        if (qmlp->layers[i].inputScale > 0)
+            qmlp->layers[i].inputScale /= 127;
+        else
+            qmlp->layers[i].inputScale = 1;
+    }
+}
+
+/* Creates a quantized copy of the given neural network. */
+QMLP *qmlp_create(MLP *mlp, Matrix samples)
+{
+    int *sizes = malloc((mlp->depth + 2) * sizeof(int));
+    sizes[0] = mlp->layers[0].weights.columns;
+    for (int i = 0; i <= mlp->depth; i++)
+        sizes[i + 1] = mlp->layers[i].weights.rows;
+
+    QMLP *qmlp = qmlp_allocate(mlp->depth, mlp->batchSize, sizes);
+    free(sizes);
+
+    for (int i = 0; i <= mlp->depth; i++)
+    {
+        Layer *layer = &mlp->layers[i];
+        QLayer *qlayer = &qmlp->layers[i];
+        qlayer->activationCode = layer->activationCode;
+        qlayer->activation = layer->activation;
+
+        for (int row = 0; row < qlayer->outputSize; row++)
+        {
+            Scalar *w = layer->weights.data + row * layer->weights.columns;
+            int8_t *q = qlayer->weights + row * qlayer->stride;
+
+            /* The largest absolute weight in the row maps to 127. */
+            double max = 0;
+            for (int col = 0; col < qlayer->inputSize; col++)
+                if (fabs(w[col]) > max)
+                    max = fabs(w[col]);
+            double scale = max > 0 ? max / 127 : 1;
+
+            for (int col = 0; col < qlayer->inputSize; col++)
+                q[col] = (int8_t)lrint(w[col] / scale);
+
+            qlayer->scales[row] = (float)scale;
+            qlayer->biases[row] = layer->biases.data[row];
+        }
+
+        qmlp_compute_row_sums(qlayer);
+    }
+
+    qmlp_calibrate(qmlp, mlp, samples);
+
+    return qmlp;
+}
+
+/* Destroys a quantized neural network. */
+void qmlp_destroy(QMLP *qmlp)
+{
+    for (int i = 0; i <= qmlp->depth; i++)
+    {
+        free(qmlp->layers[i].weights);
+        free(qmlp->layers[i].scales);
+        free(qmlp->layers[i].rowSums);
+        free(qmlp->layers[i].biases);
+    }
+
+    free(qmlp->quantized);
+    free(qmlp->products);
+    free(qmlp->activations[0]);
+    free(qmlp->activations[1]);
+    matrix_destroy(qmlp->output);
+
+    free(qmlp->layers);
+    free(qmlp);
+}
+
+/*
+   Performs a feedforward operation on the whole batch, one layer at a time. The inputs of
+   all the samples are quantized, multiplied with the quantized weights in integer arithmetic
+   and the results are converted back to real values.
+*/
+Matrix qmlp_feedforward(QMLP *qmlp, Matrix x)
+{
+    int samples = x.rows;
+    const Scalar *input = x.data;
+    int inputStride = x.columns;
+
+    for (int i = 0; i <= qmlp->depth; i++)
+    {
+        QLayer *layer = &qmlp->layers[i];
+        Scalar *output = i < qmlp->depth ? qmlp->activations[i % 2] : qmlp->output.data;
+
+        /* Quantize the inputs. The padding maps to 0. */
+        float inverseScale = 1 / layer->inputScale;
+        for (int s = 0; s < samples; s++)
+        {
+            const Scalar *sampleInput = input + s * inputStride;
+            uint8_t *quantized = qmlp->quantized + s * layer->stride;
+            for (int col = 0; col < layer->inputSize; col++)
+            {
+                long q = lrintf((float)sampleInput[col] * inverseScale);
+                if (q > 127)
+                    q = 127;
+                else if (q < -127)
+                    q = -127;
+                quantized[col] = (uint8_t)(q + 128);
+            }
+            for (int col = layer->inputSize; col < layer->stride; col++)
+                quantized[col] = 128;
+        }
+
+        /* Each block of weight rows is multiplied with all the samples before the next one is loaded. */
+        int blockRows = QMLP_BLOCK / layer->stride > 0 ? QMLP_BLOCK / layer->stride : 1;
+        for (int row = 0; row < layer->outputSize; row += blockRows)
+        {
+            int rows = layer->outputSize - row < blockRows ? layer->outputSize - row : blockRows;
+            simd.gemmInt8(qmlp->quantized, samples, layer->weights + row * layer->stride, rows, layer->stride,
+                qmlp->products + row, layer->outputSize);
+        }
+
+        /* Remove the shift and scale back. */
+        for (int s = 0; s < samples; s++)
+        {
+            int32_t *products = qmlp->products + s * layer->outputSize;
+            Scalar *sampleOutput = output + s * layer->outputSize;
+            for (int row = 0; row < layer->outputSize; row++)
+            {
+                int32_t product = products[row] - 128 * layer->rowSums[row];
+                sampleOutput[row] = (Scalar)product * (layer->inputScale * layer->scales[row]);
+            }
+        }
+
+        /* Add the bias and activate, with the same epilogue as the floating point GEMM. */
+        GemmEpilogue epilogue = { layer->biases, 0, 1, layer->activationCode };
+        simd.gemmEpilogue(output, layer->outputSize, 1, samples, layer->outputSize, &epilogue);
+
+        input = output;
+        inputStride = layer->outputSize;
+    }
+
+    Matrix output = qmlp->output;
+    output.rows = x.rows;
+    return output;
+}
+
+/* Compares the outputs of the quantized and the original neural network. */
+double qmlp_report(QMLP *qmlp, MLP *mlp, Matrix x, FILE *stream)
+{
+    double maxError = 0, sumError = 0, sumSquaredError = 0, sumSquared = 0;
+    int count = 0;
+
+    for (int start = 0; start < x.rows; start += mlp->batchSize)
+    {
+        int rows = x.rows - start < mlp->batchSize ? x.rows - start : mlp->batchSize;
+        Matrix batch = matrix_rows(x, start, rows);
+
+        Matrix expected = mlp_feedforward(mlp, batch);
+        Matrix predicted = qmlp_feedforward(qmlp, batch);
+
+        for (int i = 0; i < rows * predicted.columns; i++)
+        {
+            double error = fabs((double)predicted.data[i] - expected.data[i]);
+            if (error > maxError)
+                maxError = error;
+            sumError += error;
+            sumSquaredError += error * error;
+            sumSquared += (double)expected.data[i] * expected.data[i];
+            count++;
+        }
+    }
+
+    if (stream != NULL && count > 0)
+    {
+        fprintf(stream, "Quantized MLP accuracy over %d outputs:\n", count);
+        fprintf(stream, "  max absolute error:   %g\n", maxError);
+        fprintf(stream, "  mean absolute error:  %g\n", sumError / count);
+        fprintf(stream, "  RMS error:            %g\n", sqrt(sumSquaredError / count));
+        fprintf(stream, "  relative RMS error:   %g\n", sumSquared > 0 ? sqrt(sumSquaredError / sumSquared) : 0);
+    }
+
+    return maxError;
+}
+
+int qmlp_save(QMLP *qmlp, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+        return -1;
+
+    int result = qmlp_write(qmlp, file);
+    fclose(file);
+
+    return result;
+}
+
+/*
+   The file starts with a header that contains the architecture: the tag, the
+   depth, the batch size, the layer sizes and the activation codes. It is
+   followed by the data of each layer.
+*/
+int qmlp_write(QMLP *qmlp, FILE *file)
+{
+    int header[3] = { QMLP_FILE_TAG, qmlp->depth, qmlp->batchSize };
+    if (fwrite(header, sizeof(int), 3, file) != 3)
+        return -1;
+
+    if (fwrite(&qmlp->layers[0].inputSize, sizeof(int), 1, file) != 1)
+        return -1;
+
+    for (int i = 0; i <= qmlp->depth; i++)
+    {
+        if (fwrite(&qmlp->layers[i].outputSize, sizeof(int), 1, file) != 1)
+            return -1;
+        if (fwrite(&qmlp->layers[i].activationCode, sizeof(int), 1, file) != 1)
+            return -1;
+    }
+
+    for (int i = 0; i <= qmlp->depth; i++)
+    {
+        QLayer *layer = &qmlp->layers[i];
+
+        if (fwrite(&layer->inputScale, sizeof(float), 1, file) != 1)
+            return -1;
+
+        if (fwrite(layer->scales, sizeof(float), layer->outputSize, file) != layer->outputSize)
+            return -1;
+
+        for (int row = 0; row < layer->outputSize; row++)
+            if (fwrite(layer->weights + row * layer->stride, sizeof(int8_t), layer->inputSize, file) != layer->inputSize)
+                return -1;
+
+        Matrix biases = { 1, layer->outputSize, layer->biases };
+        if (matrix_write(biases, file) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+QMLP *qmlp_load(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return NULL;
+
+    QMLP *qmlp = qmlp_read(file);
+    fclose(file);
+
+    return qmlp;
+}
+
+QMLP *qmlp_read(FILE *file)
+{
+    int header[3];
+    if (fread(header, sizeof(int), 3, file) != 3 || header[0] != QMLP_FILE_TAG || header[1] < 0 || header[2] <= 0)
+        return NULL;
+
+    int depth = header[1];
+    int *sizes = malloc((depth + 2) * sizeof(int));
+    int *activations = malloc((depth + 1) * sizeof(int));
+
+    int error = fread(&sizes[0], sizeof(int), 1, file) != 1 || sizes[0] <= 0;
+    for (int i = 0; i <= depth && !error; i++)
+    {
+        if (fread(&sizes[i + 1], sizeof(int), 1, file) != 1 || sizes[i + 1] <= 0)
+            error = 1;
+        else if (fread(&activations[i], sizeof(int), 1, file) != 1
+            || activations[i] < ACTIVATION_NONE || activations[i] > ACTIVATION_RELU)
+            error = 1;
+    }
+
+    if (error)
+    {
+        free(sizes);
+        free(activations);
+        return NULL;
+    }
+
+    QMLP *qmlp = qmlp_allocate(depth, header[2], sizes);
+    free(sizes);
+
+    for (int i = 0; i <= depth && !error; i++)
+    {
+        QLayer *layer = &qmlp->layers[i];
+        layer->activationCode = activations[i];
+        layer->activation = getActivationFunction(activations[i]);
+
+        if (fread(&layer->inputScale, sizeof(float), 1, file) != 1)
+            error = 1;
+        else if (fread(layer->scales, sizeof(float), layer->outputSize, file) != layer->outputSize)
+            error = 1;
+
+        for (int row = 0; row < layer->outputSize && !error; row++)
+            if (fread(layer->weights + row * layer->stride, sizeof(int8_t), layer->inputSize, file) != layer->inputSize)
+                error = 1;
+
+        if (!error)
+        {
+            Matrix biases = matrix_read(file);
+            if (biases.data == NULL || biases.rows * biases.columns != layer->outputSize)
+                error = 1;
+            else
+                for (int row = 0; row < layer->outputSize; row++)
+                    layer->biases[row] = biases.data[row];
+            matrix_destroy(biases);
+        }
+
+        qmlp_compute_row_sums(layer);
+    }
+
+    free(activations);
+
+    if (error)
+    {
+        qmlp_destroy(qmlp);
+        return NULL;
+    }
+
+    return qmlp;
+}
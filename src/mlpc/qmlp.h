@@ -0,0 +1,207 @@
+/**
+ * \file   qmlp.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Quantized MLPs for inference
+ *
+ * This unit converts a trained MLP into a quantized MLP (QMLP), which can only
+ * perform the feedforward operation, but stores its weights as 8-bit integers.
+ * This reduces the size of the weights by a factor of 8 (4 in the float
+ * variant of the library) and replaces the floating point products with
+ * integer ones.
+ *
+ * The quantization is symmetric. Each row of a weight matrix (the weights of
+ * one neuron) has its own scale, chosen so that the largest absolute weight in
+ * the row maps to 127. The inputs of each layer are quantized with a single
+ * scale, which is calibrated by running a user-supplied sample of inputs
+ * through the original MLP and recording the largest absolute input value of
+ * every layer. Inputs outside the calibrated range are clipped.
+ *
+ * The products are accumulated as 32-bit integers and then converted back to
+ * real values, after which the (unquantized) biases are added and the
+ * activation function is applied. The quantized inputs are stored shifted by
+ * 128 as unsigned bytes, which is the form required by the VNNI instructions.
+ * The shift is compensated with the precomputed sum of each weight row.
+ *
+ * A batch is processed one layer at a time. The inputs of all the samples are
+ * quantized once, and the integer GEMM multiplies them with blocks of weight
+ * rows small enough to stay in the L1 cache, loading each weight row once for
+ * every few samples.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "mlp.h"
+
+/**
+ * Definition of a quantized layer.
+ */
+typedef struct QLayer
+{
+    /**
+     * The number of inputs to the layer (neurons on the previous layer).
+     */
+    int inputSize;
+
+    /**
+     * The number of neurons on the layer.
+     */
+    int outputSize;
+
+    /**
+     * The row length of the `weights` array. It is the `inputSize` rounded up
+     * to a multiple of `SIMD_INT8_BLOCK`. The padding is filled with zeros.
+     */
+    int stride;
+
+    /**
+     * The quantized weights, one row of length `stride` for each neuron.
+     */
+    int8_t *weights;
+
+    /**
+     * The scale of each weight row. The real weight equals the quantized
+     * weight multiplied by the scale.
+     */
+    float *scales;
+
+    /**
+     * The sum of the quantized weights in each row, used to compensate the
+     * shift of the quantized inputs.
+     */
+    int32_t *rowSums;
+
+    /**
+     * The biases, one for each neuron. These are not quantized.
+     */
+    Scalar *biases;
+
+    /**
+     * The scale of the quantized inputs, obtained by calibration.
+     */
+    float inputScale;
+
+    /**
+     * The integer code of the activation function used on this layer.
+     */
+    int activationCode;
+
+    /**
+     * The activation function used on this layer.
+     */
+    ActivationFunction activation;
+} QLayer;
+
+/**
+ * Definition of a quantized MLP.
+ */
+typedef struct QMLP
+{
+    /**
+     * The number of the hidden layers.
+     */
+    int depth;
+
+    /**
+     * The maximum number of samples that can be processed at once.
+     */
+    int batchSize;
+
+    /**
+     * The array of layers, from the first hidden layer to the output layer at
+     * index `depth`.
+     */
+    QLayer *layers;
+
+    /**
+     * A preallocated buffer for the quantized inputs of a layer.
+     * Format: (batch size × largest layer stride)
+     */
+    uint8_t *quantized;
+
+    /**
+     * A preallocated buffer for the integer products of a layer.
+     * Format: (batch size × largest layer size)
+     */
+    int32_t *products;
+
+    /**
+     * Two preallocated buffers that hold the outputs of consecutive layers.
+     * Format: (batch size × largest layer size)
+     */
+    Scalar *activations[2];
+
+    /**
+     * The preallocated output matrix. Only the rows of the samples given to
+     * the last feedforward call are valid.
+     * Format: (batch size × output size)
+     */
+    Matrix output;
+} QMLP;
+
+/**
+ * Creates a quantized copy of the given `mlp`. The input ranges of the layers
+ * are calibrated on the `samples` matrix (samples × input size), which should
+ * contain inputs that are representative of those seen at inference. Any
+ * number of samples may be given. A QMLP created with this function must
+ * eventually be destroyed by calling `qmlp_destroy`.
+ *
+ * \returns The newly created QMLP.
+ */
+QMLP *qmlp_create(MLP *mlp, Matrix samples);
+
+/**
+ * Frees the memory allocated on the heap by the given QMLP.
+ */
+void qmlp_destroy(QMLP *qmlp);
+
+/**
+ * Performs the feedforward operation on the given batch `x` (samples × input
+ * size). The number of samples may be anything up to the batch size of the
+ * original MLP.
+ *
+ * \returns The predicted values (samples × output size). The returned matrix
+ * must not be destroyed by the caller.
+ */
+Matrix qmlp_feedforward(QMLP *qmlp, Matrix x);
+
+/**
+ * Runs the inputs `x` (samples × input size) through both the quantized and
+ * the original MLP and compares the outputs. The maximum absolute error, the
+ * mean absolute error, the root mean square error, and the root mean square
+ * error relative to the root mean square of the original outputs are written
+ * to `stream`, if it is not NULL. Any number of samples may be given.
+ *
+ * \returns The maximum absolute error.
+ */
+double qmlp_report(QMLP *qmlp, MLP *mlp, Matrix x, FILE *stream);
+
+/**
+ * Saves the quantized MLP to a file.
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int qmlp_save(QMLP *qmlp, const char *filename);
+
+/**
+ * Saves the quantized MLP to a binary stream.
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int qmlp_write(QMLP *qmlp, FILE *file);
+
+/**
+ * Loads a quantized MLP from a file. The file contains the complete
+ * architecture, so no other information is needed. A QMLP created with this
+ * function must eventually be destroyed by calling `qmlp_destroy`.
+ *
+ * \returns The loaded QMLP, or NULL if the file could not be read.
+ */
+QMLP *qmlp_load(const char *filename);
+
+/**
+ * Loads a quantized MLP from a binary stream.
+ *
+ * \returns The loaded QMLP, or NULL if the stream could not be read.
+ */
+QMLP *qmlp_read(FILE *file);
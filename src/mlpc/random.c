@@ -1,18 +1,207 @@
-#include <stdlib.h>
+#include <math.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "random.h"
+#include "simd.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+#define RANDOM_PI 3.14159265358979323846
+
+/* Fills arrays shorter than this with the scalar generator, which needs no lane setup. */
+#define RANDOM_BULK (8 * RANDOM_LANES)
+
+/* The seed of the default generators. A new generation makes all the threads reseed. */
+static atomic_ullong defaultSeed = 0x9E3779B97F4A7C15ull;
+static atomic_uint generation = 1;
+static atomic_int threadCount = 0;
+
+/* The default generator of each thread and the generation it was seeded for. */
+static THREAD_LOCAL DeepcRng threadRng;
+static THREAD_LOCAL unsigned int threadGeneration = 0;
+
+/* The SplitMix64 generator, which turns any seed into a well mixed state. */
+static uint64_t random_splitmix(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t random_rotate(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+void deepc_rng_seed(DeepcRng *rng, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+        rng->s[i] = random_splitmix(&seed);
+}
+
+/* The xoshiro256** generator, whose low bits are as good as the high ones. */
+uint64_t deepc_rng_next(DeepcRng *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = random_rotate(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = random_rotate(s[3], 45);
+
+    return result;
+}
+
+void deepc_rng_jump(DeepcRng *rng)
+{
+    static const uint64_t jump[4] = {
+        0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (jump[i] & (1ull << b))
+                for (int k = 0; k < 4; k++)
+                    s[k] ^= rng->s[k];
+            deepc_rng_next(rng);
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+        rng->s[k] = s[k];
+}
+
+/*
+   The new state is seeded from the next output of rng rather than jumped, since the
+   default generators of the threads are already 2^128 steps apart, and a jump of the
+   same length would move rng onto the stream of the next thread.
+*/
+DeepcRng deepc_rng_split(DeepcRng *rng)
+{
+    DeepcRng split;
+    deepc_rng_seed(&split, deepc_rng_next(rng));
+    return split;
+}
+
+/* The values above the largest multiple of the range are rejected, so that all the results are equally likely. */
+int deepc_rng_int(DeepcRng *rng, int min, int max)
+{
+    uint64_t range = (uint64_t)((int64_t)max - min) + 1;
+    uint64_t limit = UINT64_MAX - UINT64_MAX % range;
+    uint64_t x;
+    do
+        x = deepc_rng_next(rng);
+    while (x >= limit);
+
+    return (int)((int64_t)min + (int64_t)(x % range));
+}
+
+double deepc_rng_double(DeepcRng *rng, double min, double max)
+{
+    return (deepc_rng_next(rng) >> 11) * 0x1.0p-53 * (max - min) + min;
+}
+
+/* The Box-Muller transform of two uniform numbers. */
+double deepc_rng_gaussian(DeepcRng *rng, double mean, double stddev)
+{
+    double u1 = 1 - deepc_rng_double(rng, 0, 1);
+    double u2 = deepc_rng_double(rng, 0, 1);
+    return mean + stddev * sqrt(-2 * log(u1)) * cos(2 * RANDOM_PI * u2);
+}
+
+/*
+   Fills whole blocks of RANDOM_LANES values with the SIMD kernel, whose lane generators
+   are seeded from rng, and the rest of the array with rng itself.
+*/
+void deepc_rng_fill_uniform(DeepcRng *rng, Scalar *dst, int n, double min, double max)
+{
+    int bulk = 0;
+    if (n >= RANDOM_BULK)
+    {
+        uint64_t state[4 * RANDOM_LANES];
+        for (int lane = 0; lane < RANDOM_LANES; lane++)
+        {
+            uint64_t seed = deepc_rng_next(rng);
+            for (int k = 0; k < 4; k++)
+                state[k * RANDOM_LANES + lane] = random_splitmix(&seed);
+        }
+
+        int blocks = n / RANDOM_LANES;
+        simd.randomUniform(state, dst, blocks, (Scalar)min, (Scalar)(max - min));
+        bulk = blocks * RANDOM_LANES;
+    }
+
+    for (int i = bulk; i < n; i++)
+        dst[i] = (Scalar)deepc_rng_double(rng, min, max);
+}
+
+/* Transforms pairs of uniform numbers from the bulk fill with Box-Muller. */
+void deepc_rng_fill_gaussian(DeepcRng *rng, Scalar *dst, int n, double mean, double stddev)
+{
+    int pairs = n / 2;
+    deepc_rng_fill_uniform(rng, dst, 2 * pairs, 0, 1);
+
+    for (int i = 0; i < pairs; i++)
+    {
+        double r = stddev * sqrt(-2 * log(1 - (double)dst[2 * i]));
+        double angle = 2 * RANDOM_PI * dst[2 * i + 1];
+        dst[2 * i] = (Scalar)(mean + r * cos(angle));
+        dst[2 * i + 1] = (Scalar)(mean + r * sin(angle));
+    }
+
+    if (n % 2)
+        dst[n - 1] = (Scalar)deepc_rng_gaussian(rng, mean, stddev);
+}
 
 void deepc_random_init()
 {
-    srand((unsigned int)time(NULL));
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    deepc_random_seed((uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+}
+
+void deepc_random_seed(uint64_t seed)
+{
+    atomic_store(&defaultSeed, seed);
+    atomic_store(&threadCount, 0);
+    atomic_fetch_add(&generation, 1);
+
+    /* The calling thread always gets the first stream. */
+    deepc_random_generator();
+}
+
+/* Each thread starts from the default seed, jumped ahead by the number of threads seeded before it. */
+DeepcRng *deepc_random_generator()
+{
+    unsigned int current = atomic_load(&generation);
+    if (threadGeneration != current)
+    {
+        deepc_rng_seed(&threadRng, atomic_load(&defaultSeed));
+        int index = atomic_fetch_add(&threadCount, 1);
+        for (int i = 0; i < index; i++)
+            deepc_rng_jump(&threadRng);
+        threadGeneration = current;
+    }
+    return &threadRng;
 }
 
 int deepc_random_int(int min, int max)
 {
-    return rand() % (max - min + 1) + min;
+    return deepc_rng_int(deepc_random_generator(), min, max);
 }
 
 double deepc_random_double(double min, double max)
 {
-    return ((double)rand() / RAND_MAX) * (max - min) + min;
-}
\ No newline at end of file
+    return deepc_rng_double(deepc_random_generator(), min, max);
+}
@@ -3,16 +3,121 @@
  * \author Domen Šoberl
  * \date   January 2023
  * \brief  Random number generators
- * 
+ *
  * This unit defines random number generators that are used by the rest of the
  * library. They are also exposed to the outside user.
+ *
+ * The generators are of the xoshiro256 family: xoshiro256** for integers and
+ * single values, and xoshiro256+ for filling arrays with floating point
+ * values. Each `DeepcRng` structure is an independent generator with a 256-bit
+ * state, which is seeded explicitly, so a sequence of numbers can always be
+ * reproduced. The `deepc_rng_jump` function advances a generator by 2^128
+ * steps, which splits its sequence into non-overlapping streams, one for each
+ * thread.
+ *
+ * The `deepc_random_*` functions use a default generator, of which every
+ * thread has its own copy. The copies are seeded from the same seed, each
+ * with a different number of jumps, so the functions are thread-safe and the
+ * threads never share a stream. The seed is taken from the clock when the
+ * library is initialized, and can be set with `deepc_random_seed`.
+ *
+ * Arrays are filled with uniform values by a SIMD kernel (see simd.h) that
+ * advances several interleaved generators at once.
  */
 
+#include <stdint.h>
+#include "scalar.h"
+
+/**
+ * The number of interleaved generators used by the bulk fill kernel.
+ */
+#define RANDOM_LANES 8
+
+/**
+ * The state of a random number generator.
+ */
+typedef struct DeepcRng
+{
+    uint64_t s[4];
+} DeepcRng;
+
+/**
+ * Seeds the generator `rng` with the given `seed`. The same seed always gives
+ * the same sequence of numbers.
+ */
+void deepc_rng_seed(DeepcRng *rng, uint64_t seed);
+
+/**
+ * \returns The next 64 random bits of the generator `rng`.
+ */
+uint64_t deepc_rng_next(DeepcRng *rng);
+
+/**
+ * Advances the generator `rng` by 2^128 steps. Calling this function k times
+ * on copies of the same generator gives k streams that do not overlap.
+ */
+void deepc_rng_jump(DeepcRng *rng);
+
+/**
+ * Splits a new generator from `rng`. The state of the new generator is seeded
+ * from the next number of `rng`, which advances `rng` by a single step. The
+ * new stream starts at an effectively random point of the 2^256 - 1 long
+ * sequence, so it does not overlap with `rng`, with other split generators or
+ * with the default generators of the threads. This is the way to hand a
+ * generator to another thread.
+ *
+ * \returns The new generator.
+ */
+DeepcRng deepc_rng_split(DeepcRng *rng);
+
+/**
+ * \returns A uniformly distributed random number of type int between ´min´
+ * and ´max´, both extremes inclusive.
+ */
+int deepc_rng_int(DeepcRng *rng, int min, int max);
+
+/**
+ * \returns A uniformly distributed random number of type double between ´min´
+ * and ´max´, with 53 bits of precision.
+ */
+double deepc_rng_double(DeepcRng *rng, double min, double max);
+
+/**
+ * \returns A normally distributed random number of type double with the given
+ * `mean` and standard deviation `stddev`.
+ */
+double deepc_rng_gaussian(DeepcRng *rng, double mean, double stddev);
+
+/**
+ * Fills the array `dst` of `n` values with uniformly distributed random
+ * numbers between ´min´ and ´max´.
+ */
+void deepc_rng_fill_uniform(DeepcRng *rng, Scalar *dst, int n, double min, double max);
+
 /**
- * Initializes the seed. This is done when initializing the library.
+ * Fills the array `dst` of `n` values with normally distributed random
+ * numbers with the given `mean` and standard deviation `stddev`.
+ */
+void deepc_rng_fill_gaussian(DeepcRng *rng, Scalar *dst, int n, double mean, double stddev);
+
+/**
+ * Seeds the default generator from the clock. This is done when initializing
+ * the library.
  */
 void deepc_random_init();
 
+/**
+ * Seeds the default generator with the given `seed`. The generators of all the
+ * threads are reseeded on their next use.
+ */
+void deepc_random_seed(uint64_t seed);
+
+/**
+ * \returns The default generator of the calling thread, which can be passed to
+ * the `deepc_rng_*` functions or split to seed other generators.
+ */
+DeepcRng *deepc_random_generator();
+
 /**
  * \returns A random number of type int between ´min´ and ´max´, both extremes
  * inclusive.
@@ -22,4 +127,4 @@ int deepc_random_int(int min, int max);
 /**
  * \returns A random number of type double between ´min´ and ´max´.
  */
-double deepc_random_double(double min, double max);
\ No newline at end of file
+double deepc_random_double(double min, double max);
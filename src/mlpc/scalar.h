@@ -0,0 +1,23 @@
+/**
+ * \file   scalar.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  The element type of matrices
+ *
+ * All the matrices, and therefore all the neural network parameters and
+ * activations, store their elements as the `Scalar` type. By default this is
+ * `double`. When the library is compiled with the `MLPC_FLOAT` macro defined,
+ * it is `float`, which halves the memory traffic and doubles the SIMD width.
+ * The Makefile builds both variants: lib/mlpc.a (double) and lib/mlpcf.a
+ * (float). A program that links the float variant must define `MLPC_FLOAT`
+ * before including the public mlpc.h header.
+ *
+ * Hyper-parameters such as learning rates, as well as the values returned by
+ * the loss functions, remain of type double in both variants.
+ */
+
+#ifdef MLPC_FLOAT
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
@@ -0,0 +1,223 @@
+#include <math.h>
+#include <string.h>
+#include "simd.h"
+#include "random.h"
+#include "gemm.h"
+#include "activation.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* The portable kernels. */
+#define KERNEL(name) name##_scalar
+#define KERNEL_VECTOR 16
+#include "kernels.h"
+#undef KERNEL_VECTOR
+#undef KERNEL
+
+#ifdef SIMD_X86
+
+/* The AVX2 kernels. FMA contraction is enabled explicitly, because it is off in ISO C mode. */
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#pragma GCC optimize("fp-contract=fast")
+#define KERNEL(name) name##_avx2
+#define KERNEL_VECTOR 32
+#include "kernels.h"
+#undef KERNEL_VECTOR
+#undef KERNEL
+#pragma GCC pop_options
+
+/* The AVX-512 kernels. */
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl,avx512dq,avx2,fma,prefer-vector-width=512")
+#pragma GCC optimize("fp-contract=fast")
+#define KERNEL(name) name##_avx512
+#define KERNEL_VECTOR 64
+#include "kernels.h"
+#undef KERNEL_VECTOR
+#undef KERNEL
+#pragma GCC pop_options
+
+/* The integer kernel for AVX-512 processors with VNNI support. */
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vnni")
+
+/* Sums each of the 16 vectors. Lane i of the result holds the sum of v[i]. */
+static inline __m512i gemmInt8_reduce16(const __m512i *v)
+{
+    __m512i pairs[8], quads[4];
+    for (int i = 0; i < 8; i++)
+        pairs[i] = _mm512_add_epi32(_mm512_unpacklo_epi32(v[2 * i], v[2 * i + 1]),
+            _mm512_unpackhi_epi32(v[2 * i], v[2 * i + 1]));
+    for (int i = 0; i < 4; i++)
+        quads[i] = _mm512_add_epi32(_mm512_unpacklo_epi64(pairs[2 * i], pairs[2 * i + 1]),
+            _mm512_unpackhi_epi64(pairs[2 * i], pairs[2 * i + 1]));
+
+    /* Each 128-bit lane now holds partial sums of four vectors. Add up the four lanes. */
+    __m512i low = _mm512_add_epi32(_mm512_shuffle_i32x4(quads[0], quads[1], 0x88),
+        _mm512_shuffle_i32x4(quads[0], quads[1], 0xDD));
+    __m512i high = _mm512_add_epi32(_mm512_shuffle_i32x4(quads[2], quads[3], 0x88),
+        _mm512_shuffle_i32x4(quads[2], quads[3], 0xDD));
+    return _mm512_add_epi32(_mm512_shuffle_i32x4(low, high, 0x88), _mm512_shuffle_i32x4(low, high, 0xDD));
+}
+
+/*
+   Computes tiles of 16 outputs, four samples by four weight rows or one sample by 16 rows,
+   whose sums are reduced together. The remaining rows are reduced one at a time.
+*/
+static void gemmInt8_vnni(const uint8_t *x, int samples, const int8_t *w, int rows, int n, int32_t *out, int rso)
+{
+    __m512i sums[16];
+    int32_t tile[16];
+
+    int s = 0;
+    for (; s + SIMD_INT8_SAMPLES <= samples; s += SIMD_INT8_SAMPLES)
+    {
+        const uint8_t *xs = x + s * n;
+        int r = 0;
+        for (; r + 4 <= rows; r += 4)
+        {
+            const int8_t *wr = w + r * n;
+            for (int i = 0; i < 16; i++)
+                sums[i] = _mm512_setzero_si512();
+            for (int k = 0; k < n; k += SIMD_INT8_BLOCK)
+            {
+                __m512i weights[4];
+                for (int j = 0; j < 4; j++)
+                    weights[j] = _mm512_loadu_si512(wr + j * n + k);
+                for (int i = 0; i < SIMD_INT8_SAMPLES; i++)
+                {
+                    __m512i input = _mm512_loadu_si512(xs + i * n + k);
+                    for (int j = 0; j < 4; j++)
+                        sums[i * 4 + j] = _mm512_dpbusd_epi32(sums[i * 4 + j], input, weights[j]);
+                }
+            }
+            _mm512_storeu_si512(tile, gemmInt8_reduce16(sums));
+            for (int i = 0; i < SIMD_INT8_SAMPLES; i++)
+                for (int j = 0; j < 4; j++)
+                    out[(s + i) * rso + r + j] = tile[i * 4 + j];
+        }
+
+        for (; r < rows; r++)
+        {
+            const int8_t *wr = w + r * n;
+            for (int i = 0; i < SIMD_INT8_SAMPLES; i++)
+                sums[i] = _mm512_setzero_si512();
+            for (int k = 0; k < n; k += SIMD_INT8_BLOCK)
+            {
+                __m512i weights = _mm512_loadu_si512(wr + k);
+                for (int i = 0; i < SIMD_INT8_SAMPLES; i++)
+                    sums[i] = _mm512_dpbusd_epi32(sums[i], _mm512_loadu_si512(xs + i * n + k), weights);
+            }
+            for (int i = 0; i < SIMD_INT8_SAMPLES; i++)
+                out[(s + i) * rso + r] = _mm512_reduce_add_epi32(sums[i]);
+        }
+    }
+
+    for (; s < samples; s++)
+    {
+        const uint8_t *xs = x + s * n;
+        int r = 0;
+        for (; r + 16 <= rows; r += 16)
+        {
+            const int8_t *wr = w + r * n;
+            for (int j = 0; j < 16; j++)
+                sums[j] = _mm512_setzero_si512();
+            for (int k = 0; k < n; k += SIMD_INT8_BLOCK)
+            {
+                __m512i input = _mm512_loadu_si512(xs + k);
+                for (int j = 0; j < 16; j++)
+                    sums[j] = _mm512_dpbusd_epi32(sums[j], input, _mm512_loadu_si512(wr + j * n + k));
+            }
+            _mm512_storeu_si512(out + s * rso + r, gemmInt8_reduce16(sums));
+        }
+
+        for (; r < rows; r++)
+        {
+            const int8_t *wr = w + r * n;
+            __m512i sum = _mm512_setzero_si512();
+            for (int k = 0; k < n; k += SIMD_INT8_BLOCK)
+                sum = _mm512_dpbusd_epi32(sum, _mm512_loadu_si512(xs + k), _mm512_loadu_si512(wr + k));
+            out[s * rso + r] = _mm512_reduce_add_epi32(sum);
+        }
+    }
+}
+#pragma GCC pop_options
+
+#endif
+
+#define SIMD_TABLE(suffix) { \
+    sum_##suffix, \
+    add_##suffix, \
+    difference_##suffix, \
+    subtract_##suffix, \
+    multiply_##suffix, \
+    divide_##suffix, \
+    odot_##suffix, \
+    fill_##suffix, \
+    lerp_##suffix, \
+    sumColumns_##suffix, \
+    gemmKernel_##suffix, \
+    gemmEpilogue_##suffix, \
+    gemv_##suffix, \
+    adam_##suffix, \
+    randomUniform_##suffix, \
+    gemmInt8_##suffix }
+
+static const SimdKernels simdScalar = SIMD_TABLE(scalar);
+#ifdef SIMD_X86
+static const SimdKernels simdAvx2 = SIMD_TABLE(avx2);
+static const SimdKernels simdAvx512 = SIMD_TABLE(avx512);
+#endif
+
+SimdKernels simd = SIMD_TABLE(scalar);
+
+static int simdLevel = SIMD_SCALAR;
+
+/* Returns the highest level supported by the running CPU. */
+static int simd_supported_level()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+int simd_init(int level)
+{
+    int supported = simd_supported_level();
+    if (level < 0 || level > supported)
+        level = supported;
+
+    switch (level)
+    {
+#ifdef SIMD_X86
+        case SIMD_AVX512:
+            simd = simdAvx512;
+            if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+                simd.gemmInt8 = gemmInt8_vnni;
+            break;
+        case SIMD_AVX2:
+            simd = simdAvx2;
+            break;
+#endif
+        default:
+            simd = simdScalar;
+            level = SIMD_SCALAR;
+    }
+
+    simdLevel = level;
+    return level;
+}
+
+int simd_level()
+{
+    return simdLevel;
+}
@@ -0,0 +1,162 @@
+/**
+ * \file   simd.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  Runtime selection of SIMD kernels
+ *
+ * The element-wise matrix operations, the column reduction, the GEMM
+ * micro-kernel, the Adam update and the bulk random number generator are
+ * compiled several times, once for each supported instruction set. The best
+ * version for the running CPU is selected when the library is initialized, so
+ * the same static library runs at full speed on older and newer machines.
+ * Until then, the portable scalar kernels are used.
+ *
+ * On AVX-512 machines that also support VNNI, the integer kernel used by
+ * quantized MLPs is replaced with one that uses the VNNI dot product
+ * instructions.
+ *
+ * The selected kernels are reached through the global `simd` table. The
+ * instruction set specific kernels are only built with GCC and Clang on x86
+ * processors. With other compilers only the scalar kernels are available.
+ */
+
+#include <stdint.h>
+#include "scalar.h"
+
+/**
+ * A forward definition of the GEMM epilogue structure (see gemm.h).
+ */
+typedef struct GemmEpilogue GemmEpilogue;
+
+/**
+ * The coefficients of one Adam step, computed once per step (see adam.h). The
+ * update of a parameter w with the gradient g and the moments m and v is:
+ *
+ *     m = beta1 * m + (1 - beta1) * g
+ *     v = beta2 * v + (1 - beta2) * g^2
+ *     w -= stepSize * m / (sqrt(v) * correction + epsilon)
+ *
+ * where stepSize = alpha / (1 - beta1^t) and correction = 1 / sqrt(1 - beta2^t).
+ */
+typedef struct AdamCoefficients
+{
+    Scalar beta1;
+    Scalar beta2;
+    Scalar stepSize;
+    Scalar correction;
+    Scalar epsilon;
+} AdamCoefficients;
+
+/** Select the best kernels that the running CPU supports. */
+#define SIMD_AUTO   -1
+
+/** Portable kernels, vectorized only for the baseline instruction set. */
+#define SIMD_SCALAR  0
+
+/** Kernels for processors that support AVX2 and FMA (Haswell and newer). */
+#define SIMD_AVX2    1
+
+/** Kernels for processors that support AVX-512 (Skylake-X, Zen 4 and newer). */
+#define SIMD_AVX512  2
+
+/**
+ * The length of the integer vectors processed by `gemmInt8` must be a multiple
+ * of this value.
+ */
+#define SIMD_INT8_BLOCK 64
+
+/**
+ * The number of samples for which `gemmInt8` loads each weight row once.
+ */
+#define SIMD_INT8_SAMPLES 4
+
+/**
+ * The table of kernels for the selected instruction set. All the vector
+ * lengths are given in elements.
+ */
+typedef struct SimdKernels
+{
+    /** dst = a + b */
+    void (*sum)(const Scalar *a, const Scalar *b, Scalar *dst, int n);
+
+    /** dst += src */
+    void (*add)(Scalar *dst, const Scalar *src, int n);
+
+    /** dst = a - b */
+    void (*difference)(const Scalar *a, const Scalar *b, Scalar *dst, int n);
+
+    /** dst -= src */
+    void (*subtract)(Scalar *dst, const Scalar *src, int n);
+
+    /** dst *= value */
+    void (*multiply)(Scalar *dst, Scalar value, int n);
+
+    /** dst /= value */
+    void (*divide)(Scalar *dst, Scalar value, int n);
+
+    /** dst *= src, element-wise */
+    void (*odot)(Scalar *dst, const Scalar *src, int n);
+
+    /** dst = value */
+    void (*fill)(Scalar *dst, Scalar value, int n);
+
+    /** dst += t * (src - dst) */
+    void (*lerp)(Scalar *dst, const Scalar *src, Scalar t, int n);
+
+    /** Sums the rows of a (rows × columns) matrix into `dst`. */
+    void (*sumColumns)(const Scalar *src, int rows, int columns, Scalar *dst);
+
+    /** The GEMM micro-kernel, see gemm.c. */
+    void (*gemmKernel)(
+        int kc, const Scalar *a, const Scalar *b,
+        Scalar *c, int rsc, int csc,
+        int mr, int nr, int accumulate,
+        const GemmEpilogue *epilogue);
+
+    /** Applies the GEMM epilogue to a (m × n) block of C. */
+    void (*gemmEpilogue)(Scalar *c, int rsc, int csc, int m, int n, const GemmEpilogue *epilogue);
+
+    /**
+     * The matrix-vector product y = W x for a row-major (rows × columns)
+     * matrix W. The result is treated as a single row of C by the epilogue.
+     */
+    void (*gemv)(int rows, int columns, const Scalar *w, const Scalar *x, Scalar *y, const GemmEpilogue *epilogue);
+
+    /** One Adam step over `n` parameters `w` with gradients `g` and moments `m` and `v`. */
+    void (*adam)(Scalar *w, const Scalar *g, Scalar *m, Scalar *v, int n, const AdamCoefficients *coefficients);
+
+    /**
+     * Fills `blocks` blocks of `RANDOM_LANES` values with uniform random
+     * numbers from [low, low + scale). The `state` holds the four state words
+     * of each of the `RANDOM_LANES` interleaved generators (see random.h),
+     * word by word.
+     */
+    void (*randomUniform)(uint64_t *state, Scalar *dst, int blocks, Scalar low, Scalar scale);
+
+    /**
+     * The integer matrix product used by quantized MLPs (see qmlp.h). Computes
+     * out[s * rso + r] = x[s] · w[r] for `samples` consecutive input rows and
+     * `rows` consecutive weight rows, all of length `n`, where `n` is a
+     * multiple of `SIMD_INT8_BLOCK`.
+     */
+    void (*gemmInt8)(const uint8_t *x, int samples, const int8_t *w, int rows, int n, int32_t *out, int rso);
+} SimdKernels;
+
+/**
+ * The kernels currently in use.
+ */
+extern SimdKernels simd;
+
+/**
+ * Selects the kernels for the given `level` (one of the `SIMD_*` codes). If the
+ * running CPU does not support the requested level, the best supported lower
+ * level is used instead.
+ *
+ * \returns The level that was actually selected.
+ */
+int simd_init(int level);
+
+/**
+ * \returns The level of the kernels currently in use.
+ */
+int simd_level();
@@ -0,0 +1,173 @@
+#include <malloc.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include "threadpool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+/* The worker threads. The calling thread is not among them. */
+static thrd_t *workers = NULL;
+static int workerCount = 0;
+
+/* Guards the state below and signals the start and the end of an operation. */
+static mtx_t mutex;
+static cnd_t started;
+static cnd_t finished;
+
+/* Only one operation can use the pool at a time. */
+static mtx_t runMutex;
+
+/* The operation in progress. */
+static ThreadTask currentTask;
+static void *currentArg;
+static int currentCount;
+static atomic_int nextIndex;
+
+/* The number of workers that are still busy with the current operation. */
+static int busyWorkers = 0;
+
+/* Incremented for every operation, so the workers can recognize a new one. */
+static unsigned long generation = 0;
+static int stopping = 0;
+
+/* Set on the threads that are currently executing tasks. */
+static THREAD_LOCAL int insideTask = 0;
+
+/* Returns the number of processor cores. */
+static int threadpool_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/* Executes the tasks of the current operation until there are none left. */
+static void threadpool_work()
+{
+    insideTask = 1;
+    int index;
+    while ((index = atomic_fetch_add(&nextIndex, 1)) < currentCount)
+        currentTask(currentArg, index, currentCount);
+    insideTask = 0;
+}
+
+static int threadpool_worker(void *arg)
+{
+    unsigned long seen = 0;
+
+    mtx_lock(&mutex);
+    for (;;)
+    {
+        while (generation == seen && !stopping)
+            cnd_wait(&started, &mutex);
+        if (stopping)
+            break;
+        seen = generation;
+        mtx_unlock(&mutex);
+
+        threadpool_work();
+
+        mtx_lock(&mutex);
+        if (--busyWorkers == 0)
+            cnd_signal(&finished);
+    }
+    mtx_unlock(&mutex);
+
+    return 0;
+}
+
+int threadpool_init(int threads)
+{
+    threadpool_shutdown();
+
+    if (threads <= 0)
+        threads = threadpool_cpu_count();
+    if (threads <= 1)
+        return 1;
+
+    mtx_init(&mutex, mtx_plain);
+    mtx_init(&runMutex, mtx_plain);
+    cnd_init(&started);
+    cnd_init(&finished);
+    stopping = 0;
+    generation = 0;
+
+    workers = malloc((threads - 1) * sizeof(thrd_t));
+    for (workerCount = 0; workerCount < threads - 1; workerCount++)
+        if (thrd_create(&workers[workerCount], threadpool_worker, NULL) != thrd_success)
+            break;
+
+    return workerCount + 1;
+}
+
+void threadpool_shutdown()
+{
+    if (workers == NULL)
+        return;
+
+    mtx_lock(&mutex);
+    stopping = 1;
+    cnd_broadcast(&started);
+    mtx_unlock(&mutex);
+
+    for (int i = 0; i < workerCount; i++)
+        thrd_join(workers[i], NULL);
+
+    free(workers);
+    workers = NULL;
+    workerCount = 0;
+
+    cnd_destroy(&started);
+    cnd_destroy(&finished);
+    mtx_destroy(&runMutex);
+    mtx_destroy(&mutex);
+}
+
+int threadpool_size()
+{
+    return workerCount + 1;
+}
+
+void threadpool_run(ThreadTask task, void *arg, int count)
+{
+    if (workerCount == 0 || count <= 1 || insideTask || mtx_trylock(&runMutex) != thrd_success)
+    {
+        for (int i = 0; i < count; i++)
+            task(arg, i, count);
+        return;
+    }
+
+    mtx_lock(&mutex);
+    currentTask = task;
+    currentArg = arg;
+    currentCount = count;
+    atomic_store(&nextIndex, 0);
+    busyWorkers = workerCount;
+    generation++;
+    cnd_broadcast(&started);
+    mtx_unlock(&mutex);
+
+    threadpool_work();
+
+    mtx_lock(&mutex);
+    while (busyWorkers > 0)
+        cnd_wait(&finished, &mutex);
+    mtx_unlock(&mutex);
+
+    mtx_unlock(&runMutex);
+}
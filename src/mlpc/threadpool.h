@@ -0,0 +1,51 @@
+/**
+ * \file   threadpool.h
+ * \author Domen Šoberl
+ * \date   October 2026
+ * \brief  A pool of worker threads for parallel kernels
+ *
+ * This unit keeps a fixed set of worker threads that are used to split large
+ * operations, such as big matrix products, into independent tasks. The pool is
+ * optional. Until it is initialized with more than one thread, every operation
+ * runs on the calling thread only.
+ *
+ * A parallel operation is given as a task function and a number of tasks. The
+ * calling thread and the workers pick up the task indices one by one until all
+ * of them are done, and only then `threadpool_run` returns. The pool runs one
+ * operation at a time. If `threadpool_run` is called from within a task, or
+ * while another thread is using the pool, the tasks are simply executed on the
+ * calling thread.
+ *
+ * The pool is built on the C11 threads library.
+ */
+
+/**
+ * A task of a parallel operation. It is called once for each `index` from 0
+ * to `count - 1`, with the same `arg` pointer.
+ */
+typedef void (*ThreadTask)(void *arg, int index, int count);
+
+/**
+ * Starts the pool with the given number of `threads`, which includes the
+ * calling thread. A value of 1 stops the workers and makes all operations
+ * single-threaded again. A value of 0 or less uses one thread for each
+ * processor core. Any previously started workers are stopped first.
+ *
+ * \returns The number of threads in the pool.
+ */
+int threadpool_init(int threads);
+
+/**
+ * Stops all the worker threads.
+ */
+void threadpool_shutdown();
+
+/**
+ * \returns The number of threads in the pool, including the calling thread.
+ */
+int threadpool_size();
+
+/**
+ * Executes `count` tasks in parallel and waits until all of them are done.
+ */
+void threadpool_run(ThreadTask task, void *arg, int count);